@@ -14,64 +14,77 @@ double calculate_distance(const Point& a, const Point& b) {
     return std::sqrt(sum);
 }
 
-// Cálculo de la distancia mínima (lower bound) entre el punto de consulta y el nodo
-double calculate_lower_bound_distance(const std::vector<double>& q_prime, TreeNode* node) {
-    double lower_bound = 0;
-    for (const auto& entry : node->entries) {
-        lower_bound += calculate_distance(Point(entry.first), Point(q_prime));  
+// Punto con los K códigos de la entrada t de una hoja, leídos de `codes`
+static Point entry_point(const TreeNode* node, size_t t, const CodeView& codes) {
+    std::vector<double> coordinates(codes.dims());
+    for (size_t j = 0; j < coordinates.size(); ++j) {
+        coordinates[j] = codes.get(node->ids[t], j);
     }
-    return lower_bound / node->entries.size();
+    return Point(std::move(coordinates));
 }
 
-// Cálculo de la distancia máxima (upper bound) entre el punto de consulta y el nodo
-double calculate_upper_bound_distance(const std::vector<double>& q_prime, TreeNode* node) {
-    double upper_bound = 0;
-    for (const auto& entry : node->entries) {
-        upper_bound += calculate_distance(Point(entry.first), Point(q_prime));
-    }
-    return upper_bound / node->entries.size();
+// Cálculo de la distancia mínima (lower bound) entre el punto de consulta y
+// la caja de regiones del nodo, en O(K)
+double calculate_lower_bound_distance(const std::vector<double>& q_prime, TreeNode* node, const RegionBounds& bounds) {
+    return std::sqrt(bounds.lower_bound2(q_prime.data(), node->box, node->box + bounds.dims()));
+}
+
+// Cálculo de la distancia máxima (upper bound) entre el punto de consulta y
+// la caja de regiones del nodo, en O(K)
+double calculate_upper_bound_distance(const std::vector<double>& q_prime, TreeNode* node, const RegionBounds& bounds) {
+    return std::sqrt(bounds.upper_bound2(q_prime.data(), node->box, node->box + bounds.dims()));
 }
 
 
 // Función recursiva para recorrer el subárbol y encontrar puntos dentro del rango
-void traverse_subtree(TreeNode* node, const std::vector<double>& q_prime, double r_prime, std::vector<Point>& S) {
+void traverse_subtree(TreeNode* node, const CodeView& codes, const RegionBounds& bounds, const std::vector<double>& q_prime, double r_prime, std::vector<std::pair<Point, int>>& S) {
     if (node == nullptr) return;  // Si el nodo es nulo, terminamos.
 
     // 1. Calcula la distancia mínima entre q_prime y el nodo
-    double lower_bound_dist = calculate_lower_bound_distance(q_prime, node);
+    double lower_bound_dist = calculate_lower_bound_distance(q_prime, node, bounds);
     if (lower_bound_dist > r_prime) return;  // Si la distancia mínima es mayor que el radio, terminamos.
 
     // 2. Si el nodo es una hoja
-    if (node->left == nullptr && node->right == nullptr) {
-        double upper_bound_dist = calculate_upper_bound_distance(q_prime, node);
+    if (node->is_leaf()) {
+        double upper_bound_dist = calculate_upper_bound_distance(q_prime, node, bounds);
         if (upper_bound_dist <= r_prime) {
             // Agrega todos los puntos de este nodo
-            for (const auto& entry : node->entries) {
-                S.push_back(entry.first);  // Agregar solo el punto
+            for (uint32_t t = 0; t < node->count; ++t) {
+                S.push_back({entry_point(node, t, codes), static_cast<int>(node->ids[t])});
             }
         } else {
-            // Si no, recorrer los puntos del nodo
-            for (const auto& entry : node->entries) {
-                double dist = calculate_distance(Point(entry.first), Point(q_prime));  // Comparar con el punto proyectado
-                if (dist <= r_prime) {
-                    S.push_back(entry.first);  // Agregar punto si está dentro del rango
+            // Si no, revisar la región de cada punto (una caja de una sola región)
+            uint8_t code[32];  // La raíz tiene 2^K hijos: K < 32
+            for (uint32_t t = 0; t < node->count; ++t) {
+                codes.unpack(node->ids[t], code);
+                if (bounds.lower_bound2(q_prime.data(), code, code) <= r_prime * r_prime) {
+                    S.push_back({entry_point(node, t, codes), static_cast<int>(node->ids[t])});  // Agregar punto si está dentro del rango
                 }
             }
         }
+        return;
     }
 
-    // 3. Recursión sobre los hijos izquierdo y derecho
-    traverse_subtree(node->left, q_prime, r_prime, S);
-    traverse_subtree(node->right, q_prime, r_prime, S);
+    // 3. Recursión sobre los hijos de la raíz y los hijos izquierdo y derecho
+    for (uint32_t c = 0; c < node->child_count; ++c) {
+        traverse_subtree(node->children[c], codes, bounds, q_prime, r_prime, S);
+    }
+    traverse_subtree(node->left, codes, bounds, q_prime, r_prime, S);
+    traverse_subtree(node->right, codes, bounds, q_prime, r_prime, S);
 }
 
 
 // Algoritmo de consulta DET en rango
-std::vector<Point> DETRangeQuery(const std::vector<double>& query, double radius, TreeNode* root, int K) {
-    std::vector<Point> result;
+std::vector<Point> DETRangeQuery(const std::vector<double>& query, double radius, TreeNode* root, const CodeView& codes, const RegionBounds& bounds, int K) {
+    std::vector<std::pair<Point, int>> found;
 
     // Llamar a TraverseSubtree para comenzar la búsqueda en la raíz
-    traverse_subtree(root, query, radius, result);
+    traverse_subtree(root, codes, bounds, query, radius, found);
+
+    std::vector<Point> result;
+    for (auto& entry : found) {
+        result.push_back(std::move(entry.first));
+    }
 
     // Limitar el número de resultados a K si es necesario
     if (result.size() > K) {
@@ -82,6 +95,8 @@ std::vector<Point> DETRangeQuery(const std::vector<double>& query, double radius
 }
 std::vector<std::pair<Point, int>> det_range_query(
     TreeNode* root,
+    const CodeView& codes,
+    const RegionBounds& bounds,
     const std::vector<double>& q_prime,
     double r_prime,
     int K
@@ -93,29 +108,10 @@ std::vector<std::pair<Point, int>> det_range_query(
         return result;
     }
 
-    // Aquí iría la lógica para procesar el nodo actual en base a q_prime y r_prime
-    // Por ejemplo, puedes buscar los puntos en el nodo que estén dentro del rango r_prime
-    for (const auto& entry : root->entries) {
-        // Compara la distancia entre el punto en "entry" y q_prime
-        double dist = 0.0;
-        for (size_t i = 0; i < q_prime.size(); ++i) {
-            dist += std::pow(entry.first.coordinates[i] - q_prime[i], 2);
-        }
-        dist = std::sqrt(dist);
-
-        // Si la distancia es menor o igual a r_prime, agregamos el punto a los resultados
-        if (dist <= r_prime) {
-            result.push_back(entry);
-        }
-    }
-
-    // Llamamos recursivamente a los subárboles izquierdo y derecho si son relevantes
-    if (root->left != nullptr) {
-        result = det_range_query(root->left, q_prime, r_prime, K);  // Consulta recursiva en el subárbol izquierdo
-    }
-    if (root->right != nullptr) {
-        result = det_range_query(root->right, q_prime, r_prime, K);  // Consulta recursiva en el subárbol derecho
-    }
+    // La caja de la raíz cubre todo el árbol (insert_point y bulk_load la
+    // amplían), así que un q' lejos de todo se descarta ahí; si no, se
+    // recorren sus 2^K hijos, que podan con las cotas de sus propias cajas
+    traverse_subtree(root, codes, bounds, q_prime, r_prime, result);
 
     return result;  
 }
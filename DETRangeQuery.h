@@ -3,21 +3,27 @@
 
 #include <vector>
 #include "tree_node.h"
+#include "packed_codes.h"
+#include "region_bounds.h"
 #include "point.h"  // Asegúrate de incluir el archivo de definición de Point
 
 // Algoritmo 4: Consulta de rango en el árbol DET
+// Los códigos de las hojas se leen de `codes` (espacio del árbol) y las
+// cotas de cada nodo salen de su caja de regiones y de los breakpoints
 std::vector<std::pair<Point, int>> det_range_query(
     TreeNode* root,
+    const CodeView& codes,
+    const RegionBounds& bounds,
     const std::vector<double>& q_prime,
     double r_prime,
     int K
 );
 
 // Algoritmo 5: Recorrido del subárbol en el árbol DET para la consulta de rango
-void traverse_subtree(TreeNode* node, const std::vector<double>& q_prime, double r_prime, std::vector<std::pair<Point, int>>& S);
+void traverse_subtree(TreeNode* node, const CodeView& codes, const RegionBounds& bounds, const std::vector<double>& q_prime, double r_prime, std::vector<std::pair<Point, int>>& S);
 
 
-std::vector<Point> DETRangeQuery(const std::vector<double>& query, double radius, int detTree, int K);
+std::vector<Point> DETRangeQuery(const std::vector<double>& query, double radius, TreeNode* root, const CodeView& codes, const RegionBounds& bounds, int K);
 
 
 #endif // DETRANGEQUERY_H
@@ -3,26 +3,151 @@
 #include <algorithm>
 #include <limits>
 #include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include "counter_rng.h"
+#include "candidate_set.h"
 
 using namespace std::chrono;
 
-LSH::LSH(int K, int L, int d, double w) 
-    : K(K), L(L), d(d), w(w), gen(rd()), dis(0.0, 1.0), uniform_dis(0.0, w) {
+namespace {
+const uint32_t LSH_FILE_MAGIC = 0x4848534C;  // "LSHH"
+const uint32_t LSH_FILE_VERSION = 1;
+}
+
+LSH::LSH(int K, int L, int d, double w, uint64_t seed)
+    : K(K), L(L), d(d), w(w), seed(seed) {
     H = generate_hash_functions();
+    stack_hash_functions();
 }
 
-vector<vector<pair<Eigen::VectorXd, double>>> LSH::generate_hash_functions() {
-    vector<vector<pair<Eigen::VectorXd, double>>> H(L, vector<pair<Eigen::VectorXd, double>>(K));
+// Copia H a una matriz (L·K) × d en float para proyectar por bloques
+void LSH::stack_hash_functions() {
+    A.resize(L * K, d);
+    b.resize(L * K);
     for (int i = 0; i < L; ++i) {
         for (int j = 0; j < K; ++j) {
-            Eigen::VectorXd a = Eigen::VectorXd::NullaryExpr(d, [&]() { return dis(gen); });
-            double b = uniform_dis(gen);
-            H[i][j] = make_pair(a, b);
+            A.row(i * K + j) = H[i][j].first.cast<float>().transpose();
+            b[i * K + j] = static_cast<float>(H[i][j].second);
         }
     }
+    inv_w = static_cast<float>(1.0 / w);
+}
+
+void LSH::project_tile(const DatasetView& tile, Eigen::MatrixXf& out) const {
+    using StridedRows = Eigen::Map<const Eigen::MatrixXf, 0, Eigen::OuterStride<>>;
+    // Cada fila del dataset es una columna de X (d × filas), sin copiar
+    StridedRows X(tile.data, d, tile.size(), Eigen::OuterStride<>(tile.stride));
+
+    out.noalias() = A * X;
+    out = ((out.colwise() + b) * inv_w).array().floor().matrix();
+}
+
+void LSH::project_query(const float* point, float* out) const {
+    Eigen::Map<const Eigen::VectorXf> x(point, d);
+    Eigen::Map<Eigen::VectorXf> y(out, L * K);
+
+    y.noalias() = A * x;
+    y = ((y + b) * inv_w).array().floor().matrix();
+}
+
+// Cada función hash f = i·K + j usa su propio rango de contadores, así que
+// se pueden generar en paralelo y siempre salen iguales para la misma semilla
+vector<vector<pair<Eigen::VectorXd, double>>> LSH::generate_hash_functions(ThreadPool& pool) {
+    vector<vector<pair<Eigen::VectorXd, double>>> H(L, vector<pair<Eigen::VectorXd, double>>(K));
+    Philox4x32 rng(seed);
+
+    pool.parallel_for(L * K, 1, [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; ++f) {
+            int i = f / K;
+            int j = f % K;
+            Eigen::VectorXd a(d);
+            for (int t = 0; t < d; t += 2) {
+                auto normals = rng.normal_pair(f << 1, t / 2);
+                a[t] = normals[0];
+                if (t + 1 < d) a[t + 1] = normals[1];
+            }
+            double b = rng.uniform((f << 1) | 1, 0) * w;
+            H[i][j] = make_pair(a, b);
+        }
+    });
     return H;
 }
 
+void LSH::save(const string& filename) const {
+    ofstream out(filename, ios::binary);
+    if (!out.is_open()) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+    save(out);
+    if (!out) {
+        throw runtime_error("Error writing LSH state to " + filename);
+    }
+}
+
+void LSH::save(ostream& out) const {
+    int32_t header[3] = {K, L, d};
+    out.write(reinterpret_cast<const char*>(&LSH_FILE_MAGIC), sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(&LSH_FILE_VERSION), sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&w), sizeof(double));
+    out.write(reinterpret_cast<const char*>(&seed), sizeof(uint64_t));
+
+    // H en orden [L][K]: d componentes de a seguidas de b
+    for (int i = 0; i < L; ++i) {
+        for (int j = 0; j < K; ++j) {
+            out.write(reinterpret_cast<const char*>(H[i][j].first.data()), d * sizeof(double));
+            out.write(reinterpret_cast<const char*>(&H[i][j].second), sizeof(double));
+        }
+    }
+}
+
+LSH LSH::load(const string& filename) {
+    ifstream in(filename, ios::binary);
+    if (!in.is_open()) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+    return load(in, filename);
+}
+
+LSH LSH::load(istream& in, const string& source) {
+    uint32_t magic = 0, version = 0;
+    int32_t header[3] = {0, 0, 0};
+    in.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+    if (!in || magic != LSH_FILE_MAGIC || version != LSH_FILE_VERSION) {
+        throw runtime_error("Not an LSH state file: " + source);
+    }
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+
+    LSH lsh;
+    lsh.K = header[0];
+    lsh.L = header[1];
+    lsh.d = header[2];
+    in.read(reinterpret_cast<char*>(&lsh.w), sizeof(double));
+    in.read(reinterpret_cast<char*>(&lsh.seed), sizeof(uint64_t));
+    if (!in || lsh.K <= 0 || lsh.L <= 0 || lsh.d <= 0) {
+        throw runtime_error("Corrupt LSH header in " + source);
+    }
+
+    lsh.H.assign(lsh.L, vector<pair<Eigen::VectorXd, double>>(lsh.K));
+    for (int i = 0; i < lsh.L; ++i) {
+        for (int j = 0; j < lsh.K; ++j) {
+            Eigen::VectorXd a(lsh.d);
+            double b = 0.0;
+            in.read(reinterpret_cast<char*>(a.data()), lsh.d * sizeof(double));
+            in.read(reinterpret_cast<char*>(&b), sizeof(double));
+            lsh.H[i][j] = make_pair(a, b);
+        }
+    }
+    if (!in) {
+        throw runtime_error("Truncated LSH state file: " + source);
+    }
+
+    lsh.stack_hash_functions();
+    return lsh;
+}
+
 vector<double> LSH::project_point(const Eigen::VectorXd& point, int space_index) {
     vector<double> hashes(K);
     for (int j = 0; j < K; ++j) {
@@ -33,45 +158,79 @@ vector<double> LSH::project_point(const Eigen::VectorXd& point, int space_index)
     return hashes;
 }
 
-vector<vector<vector<double>>> LSH::project_dataset(const vector<Eigen::VectorXd>& dataset) {
+// Proyecta una fila float32 sin copiarla a un Eigen::VectorXd, con la
+// misma fórmula en float que project_tile y project_query
+vector<double> LSH::project_point(const float* point, int space_index) {
+    Eigen::Map<const Eigen::VectorXf> x(point, d);
+    Eigen::VectorXf h = A.middleRows(space_index * K, K) * x;
+    h = ((h + b.segment(space_index * K, K)) * inv_w).array().floor().matrix();
+    return vector<double>(h.data(), h.data() + K);
+}
+
+ProjectionBuffer LSH::project_dataset(const DatasetView& dataset, ThreadPool& pool) {
 
     auto start = high_resolution_clock::now();
 
-    int n = dataset.size();
-    vector<vector<vector<double>>> projected_points(L, vector<vector<double>>(n, vector<double>(K)));
-    for (int i = 0; i < L; ++i) {
-        for (int idx = 0; idx < n; ++idx) {
-            projected_points[i][idx] = project_point(dataset[idx], i);
-        }
-    }
+    ParallelStats stats;
+    ProjectionBuffer projected_points = project_dataset(dataset, stats, pool);
 
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(stop - start);
 
 
-    cout << "Project dataset: " << duration.count() << " microseconds" << endl;
+    cout << "Project dataset: " << duration.count() << " microseconds ("
+         << stats.threads << " threads, utilization " << stats.utilization() << "x)" << endl;
+
+    return projected_points;
+}
+
+ProjectionBuffer LSH::project_dataset(const DatasetView& dataset, ParallelStats& stats, ThreadPool& pool) {
+    int n = dataset.size();
+    ProjectionBuffer projected_points(L, K, n);  // [L][K][n]
+
+    // Bloques de filas que, junto con su salida, caben en ~256 KB de caché
+    const size_t tile_bytes = 256 * 1024;
+    const size_t tile_rows = max<size_t>(16, tile_bytes / ((d + L * K) * sizeof(float)));
+
+    // Cada bloque de filas se proyecta en paralelo y escribe solo sus filas
+    stats = pool.parallel_for(n, tile_rows, [&](size_t t0, size_t t1) {
+        Eigen::MatrixXf Y;
+        project_tile(dataset.slice(t0, t1), Y);
+
+        // La fila i·K + j de Y es el tramo [t0, t1) de la columna (i, j)
+        for (int i = 0; i < L; ++i) {
+            for (int j = 0; j < K; ++j) {
+                float* column = projected_points.column(i, j) + t0;
+                for (size_t idx = t0; idx < t1; ++idx) {
+                    column[idx - t0] = Y(i * K + j, idx - t0);
+                }
+            }
+        }
+    });
 
     return projected_points;
 }
 
 
-vector<unordered_map<vector<double>, vector<Eigen::VectorXd>, LSH::VectorHash>> LSH::assign_to_buckets(const vector<Eigen::VectorXd>& dataset) {
-    // Cada bucket es un unordered_map donde la llave es un vector<double> y el valor es un vector de Eigen::VectorXd.
-    vector<unordered_map<vector<double>, vector<Eigen::VectorXd>, VectorHash>> buckets(L);
-    for (const auto& point : dataset) {
+vector<unordered_map<vector<double>, vector<uint32_t>, LSH::VectorHash>> LSH::assign_to_buckets(const vector<Eigen::VectorXd>& dataset) {
+    // Cada bucket es un unordered_map donde la llave es un vector<double> y el valor son las posiciones de sus puntos.
+    vector<unordered_map<vector<double>, vector<uint32_t>, VectorHash>> buckets(L);
+    for (size_t pos = 0; pos < dataset.size(); ++pos) {
         for (int space_index = 0; space_index < L; ++space_index) {
             // Proyectamos el punto al espacio actual
-            vector<double> bucket_key = project_point(point, space_index);
+            vector<double> bucket_key = project_point(dataset[pos], space_index);
             // Asignamos el punto al bucket correspondiente
-            buckets[space_index][bucket_key].push_back(point);
+            buckets[space_index][bucket_key].push_back(static_cast<uint32_t>(pos));
         }
     }
     return buckets;
 }
 
-vector<Eigen::VectorXd> LSH::query(const Eigen::VectorXd& query_point, const vector<unordered_map<vector<double>, vector<Eigen::VectorXd>, VectorHash>>& buckets) {
-    
-    set<Eigen::VectorXd, LSH::Comparator> candidates;
+vector<uint32_t> LSH::query(const Eigen::VectorXd& query_point, const vector<unordered_map<vector<double>, vector<uint32_t>, VectorHash>>& buckets) {
+
+    // Un conjunto por hilo: entre consultas se vacía sin liberar memoria
+    thread_local CandidateSet candidates;
+    candidates.reset();
     for (int space_index = 0; space_index < L; ++space_index) {
         
         vector<double> bucket_key = project_point(query_point, space_index);
@@ -81,5 +240,5 @@ vector<Eigen::VectorXd> LSH::query(const Eigen::VectorXd& query_point, const vec
             candidates.insert(it->second.begin(), it->second.end());
         }
     }
-    return vector<Eigen::VectorXd>(candidates.begin(), candidates.end());
+    return candidates.items();
 }
\ No newline at end of file
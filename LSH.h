@@ -6,19 +6,27 @@
 #include <unordered_map>
 #include <random>
 #include <cmath>
-#include <set>
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+#include "dataset.h"
+#include "thread_pool.h"
+#include "buffers.h"
 
 using namespace std;
 
+// Semilla fija de los experimentos: mismas proyecciones en cada corrida
+const uint64_t DEFAULT_LSH_SEED = 42;
+
 class LSH {
 private:
     int K, L, d;
     double w;
     vector<vector<pair<Eigen::VectorXd, double>>> H;
-    random_device rd;
-    mt19937 gen;
-    normal_distribution<> dis;
-    uniform_real_distribution<> uniform_dis;
+    Eigen::MatrixXf A;   // Los L·K vectores gaussianos apilados: (L·K) × d
+    Eigen::VectorXf b;   // Desplazamientos de las L·K funciones hash
+    float inv_w;         // 1 / w: todas las proyecciones float multiplican por él
+    uint64_t seed;       // Semilla del generador por contador (Philox)
 
     struct VectorHash {
         std::size_t operator()(const std::vector<double>& vec) const {
@@ -30,23 +38,55 @@ private:
         }
     };
 
-    struct Comparator {
-        bool operator()(const Eigen::VectorXd& a, const Eigen::VectorXd& b) const {
-            return a.isApprox(b);
-        }
-    };
+    LSH() = default;     // Solo para load()
 
-    
 public:
-    LSH(int K, int L, int d, double w);
+    // La semilla es obligatoria: con la misma semilla (y K, L, d, w) las
+    // funciones hash salen idénticas en cualquier máquina y con cualquier
+    // cantidad de hilos
+    LSH(int K, int L, int d, double w, uint64_t seed);
+
+    int get_K() const { return K; }
+    int get_L() const { return L; }
+    int get_d() const { return d; }
+    double get_w() const { return w; }
+    uint64_t get_seed() const { return seed; }
+
+    // Guarda/carga H, w y la semilla en binario, para que un servidor de
+    // consultas use exactamente las proyecciones del constructor offline
+    void save(const string& filename) const;
+    static LSH load(const string& filename);
+    // Lo mismo sobre un stream ya abierto (p. ej. una sección de un índice);
+    // `source` solo se usa en los mensajes de error
+    void save(ostream& out) const;
+    static LSH load(istream& in, const string& source);
 
     vector<double> project_point(const Eigen::VectorXd& point, int space_index);
+    vector<double> project_point(const float* point, int space_index);
+
 
+    vector<vector<pair<Eigen::VectorXd, double>>> generate_hash_functions(ThreadPool& pool = ThreadPool::shared());
+    void stack_hash_functions();
 
-    vector<vector<pair<Eigen::VectorXd, double>>> generate_hash_functions();
-    vector<vector<vector<double>>> project_dataset(const vector<Eigen::VectorXd>& dataset);
-    vector<unordered_map<vector<double>, vector<Eigen::VectorXd>, LSH::VectorHash>> assign_to_buckets(const vector<Eigen::VectorXd>& dataset);
-    vector<Eigen::VectorXd> query(const Eigen::VectorXd& query_point, const vector<unordered_map<vector<double>, vector<Eigen::VectorXd>, VectorHash>>& buckets);
+    // Proyecta un bloque de filas con una sola multiplicación de matrices.
+    // out queda de (L·K) × filas: la columna r tiene las L·K proyecciones
+    // (con + b, · 1/w y floor ya aplicados) de la fila r del bloque.
+    // project_tile, project_query y project_point(const float*) aplican la
+    // misma fórmula en float; solo el orden de suma del producto puede
+    // cambiar (GEMM contra matriz-vector), lo que con d de cientos puede
+    // mover en una unidad un valor que cae justo en un borde del floor.
+    void project_tile(const DatasetView& tile, Eigen::MatrixXf& out) const;
+    // Proyecta un punto en los L espacios con un solo producto matriz-vector:
+    // out[i·K + j] recibe la proyección j del espacio i, como en project_tile
+    void project_query(const float* point, float* out) const;
+    ProjectionBuffer project_dataset(const DatasetView& dataset, ThreadPool& pool = ThreadPool::shared());
+    // Igual, sin imprimir el tiempo: lo deja en `stats` (para proyectar por
+    // bloques y reportar el total una sola vez)
+    ProjectionBuffer project_dataset(const DatasetView& dataset, ParallelStats& stats, ThreadPool& pool = ThreadPool::shared());
+    // Los buckets guardan la posición de cada punto en `dataset`
+    vector<unordered_map<vector<double>, vector<uint32_t>, LSH::VectorHash>> assign_to_buckets(const vector<Eigen::VectorXd>& dataset);
+    // Posiciones de los candidatos de los L buckets de la consulta, sin repetir
+    vector<uint32_t> query(const Eigen::VectorXd& query_point, const vector<unordered_map<vector<double>, vector<uint32_t>, VectorHash>>& buckets);
 };
 
 #endif // LSH_H
\ No newline at end of file
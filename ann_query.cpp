@@ -1,147 +1,694 @@
 #include <iostream>
 #include <vector>
-#include <unordered_set>  
 #include <cmath>
+#include <limits>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include "tree_node.h"
 #include "point.h"
-#include "DETRangeQuery.h"
+#include "dataset.h"
+#include "flat_tree.h"
+#include "encode_kernel.h"
+#include "candidate_set.h"
+#include "rerank.h"
+#include "ann_query.h"
 
 using namespace std;
 
 
-std::vector<int> project_query(const Point& q, int K) {
-    if (q.coordinates.size() < K) {
-        throw std::invalid_argument("Dimensión del punto insuficiente para la proyección.");
+void project_query(const float* q, const LSH& lsh, const std::vector<FlatDETree>& DETs, ProjectedQuery& out) {
+    const int K = lsh.get_K();
+    const int L = lsh.get_L();
+    if (DETs.size() < static_cast<size_t>(L)) {
+        throw std::invalid_argument("Se necesita un DE-Tree por espacio proyectado.");
     }
-    std::vector<int> q_prime(q.coordinates.begin(), q.coordinates.begin() + K); 
-    return q_prime;
+
+    // Las L·K proyecciones salen juntas, igual que las del dataset
+    out.projected.resize(size_t(L) * K);
+    lsh.project_query(q, out.projected.data());
+    encode_projection(out.projected.data(), K, L, DETs, out);
 }
 
-double distance(const Point& a, const Point& b) {
-    double sum = 0.0;
-    for (size_t i = 0; i < a.coordinates.size(); ++i) {
-        sum += std::pow(a.coordinates[i] - b.coordinates[i], 2);
+void encode_projection(const float* projected, int K, int L, const std::vector<FlatDETree>& DETs, ProjectedQuery& out) {
+    out.K = K;
+    out.L = L;
+    out.values.resize(size_t(L) * K);
+    out.codes.resize(size_t(L) * K);
+
+    // Cada valor se codifica con el mismo kernel y los mismos breakpoints que el dataset
+    for (int i = 0; i < L; ++i) {
+        const RegionBounds& bounds = DETs[i].bounds();
+        for (int j = 0; j < K; ++j) {
+            const size_t t = size_t(i) * K + j;
+            out.values[t] = projected[t];
+            encode_regions_scalar(&projected[t], 1, bounds.row(j), bounds.regions(), &out.codes[t], 1);
+        }
     }
-    return std::sqrt(sum);
 }
 
-// Implementación de la función (r, c)-ANN Query
-Point ann_query(
-    const Point& q, 
-    int K, 
-    int L, 
-    int n, 
-    double c, 
-    double r, 
-    double epsilon, 
-    double beta, 
-    const std::vector<TreeNode*>& DETs
-) {
-    std::unordered_set<Point> S;  
+// S compartido por los hilos de una consulta paralela: un bit por punto del
+// dataset y, por árbol, los ids que ese árbol agregó primero. Cada buffer lo
+// escribe solo el hilo que recorre su árbol. Vive en la memoria de trabajo
+// del hilo que consulta: reset no vuelve a reservar, y en vez de poner en
+// cero los n bits borra solo los de los ids que agregó la consulta anterior
+// (cada bit encendido está en exactamente un buffer).
+struct SharedCandidates {
+    std::unique_ptr<std::atomic<uint64_t>[]> seen;
+    size_t seen_words = 0;
+    std::vector<std::vector<uint32_t>> fresh;
+    std::atomic<size_t> count{0};
+    std::atomic<bool> stop{false};
+
+    void reset(size_t n, int L) {
+        for (std::vector<uint32_t>& ids : fresh) {
+            for (uint32_t id : ids) {
+                seen[id >> 6].store(0, std::memory_order_relaxed);
+            }
+            ids.clear();
+        }
+        const size_t words = (n + 63) / 64;
+        if (words > seen_words) {
+            seen.reset(new std::atomic<uint64_t>[words]);
+            for (size_t w = 0; w < words; ++w) {
+                seen[w].store(0, std::memory_order_relaxed);
+            }
+            seen_words = words;
+        }
+        if (fresh.size() < static_cast<size_t>(L)) {
+            fresh.resize(L);
+        }
+        count.store(0, std::memory_order_relaxed);
+        stop.store(false, std::memory_order_relaxed);
+    }
+
+    // Agrega al buffer del árbol i los ids de Si que nadie vio; devuelve |S|
+    size_t merge(int i, const std::vector<uint32_t>& Si) {
+        size_t added = 0;
+        for (uint32_t id : Si) {
+            const uint64_t bit = uint64_t(1) << (id & 63);
+            if (!(seen[id >> 6].fetch_or(bit, std::memory_order_relaxed) & bit)) {
+                fresh[i].push_back(id);
+                added++;
+            }
+        }
+        return count.fetch_add(added, std::memory_order_relaxed) + added;
+    }
+};
+
+// Memoria de trabajo de una consulta. Hay una por hilo, así que entre
+// consultas S se vacía en O(1) y ningún buffer se vuelve a reservar.
+struct QueryScratch {
+    ProjectedQuery projected;
+    CandidateSet S;               // Conjunto de candidatos (posiciones)
+    std::vector<uint32_t> Si;     // Resultado de un árbol
+    std::vector<uint32_t> fresh;  // Ids de Si que no estaban en S
+    std::vector<RangeCursor> cursors;  // Un recorrido reanudable por árbol; reset los reusa
+    std::vector<QueryBounds> bounds;   // Tablas de cotas de q' en cada árbol
+    SharedCandidates shared;           // S de las versiones paralelas
+};
+
+static QueryScratch& thread_scratch() {
+    thread_local QueryScratch scratch;
+    return scratch;
+}
 
+// Cursores de los L árboles para la consulta ya proyectada en scratch
+static std::vector<RangeCursor>& reset_cursors(QueryScratch& scratch, const std::vector<FlatDETree>& DETs, int L) {
+    std::vector<RangeCursor>& cursors = scratch.cursors;
+    if (cursors.size() < static_cast<size_t>(L)) {
+        cursors.resize(L);
+    }
     for (int i = 0; i < L; ++i) {
+        cursors[i].reset(DETs[i], scratch.projected.q_prime(i));
+    }
+    return cursors;
+}
+
+const char* stop_reason_name(StopReason reason) {
+    switch (reason) {
+        case StopReason::Completed: return "completed";
+        case StopReason::Exhausted: return "exhausted";
+        case StopReason::Candidates: return "candidates";
+        case StopReason::Leaves: return "leaves";
+        case StopReason::Distances: return "distances";
+        case StopReason::Deadline: return "deadline";
+    }
+    return "unknown";
+}
 
-        std::vector<int> q_prime = project_query(q, K);  
-        std::vector<double> q_prime_double(q_prime.begin(), q_prime.end());
+namespace {
 
+// Lo que lleva gastado una consulta contra su QueryBudget
+class BudgetTracker {
+public:
+    // Hojas entre dos miradas al reloj cuando hay deadline
+    static const size_t LEAF_SLICE = 64;
 
-        double r_prime = epsilon * r;
-        std::vector<std::pair<Point, int>> Si = det_range_query(DETs[i], q_prime_double, r_prime, K);
+    explicit BudgetTracker(const QueryBudget& budget)
+        : budget(budget), start(std::chrono::steady_clock::now()) {}
+
+    size_t candidates = 0;
+    size_t leaves = 0;
+    size_t distances = 0;
 
+    size_t candidates_left() const { return left(budget.max_candidates, candidates); }
+    size_t distances_left() const { return left(budget.max_distances, distances); }
+
+    // Hojas que puede abrir la siguiente expansión antes de volver a revisar
+    size_t leaf_slice() const {
+        const size_t slice = budget.deadline.count() > 0 ? LEAF_SLICE : SIZE_MAX;
+        return std::min(slice, left(budget.max_leaves, leaves));
+    }
 
-        for (const auto& entry : Si) {
-            S.insert(entry.first);
+    // Si se agotó algún límite; en ese caso deja en `reason` cuál. El reloj
+    // se puede saltar en los bucles cortos
+    bool exhausted(StopReason& reason, bool check_clock = true) const {
+        if (budget.max_candidates && candidates >= budget.max_candidates) {
+            reason = StopReason::Candidates;
+        } else if (budget.max_leaves && leaves >= budget.max_leaves) {
+            reason = StopReason::Leaves;
+        } else if (budget.max_distances && distances >= budget.max_distances) {
+            reason = StopReason::Distances;
+        } else if (check_clock && budget.deadline.count() > 0 &&
+                   std::chrono::steady_clock::now() - start >= budget.deadline) {
+            reason = StopReason::Deadline;
+        } else {
+            return false;
         }
+        return true;
+    }
+
+    QueryResult finish(const TopK& top, StopReason reason) const {
+        QueryResult result;
+        result.neighbors = to_neighbors(top.sorted());
+        result.stop = reason;
+        result.candidates = candidates;
+        result.leaves = leaves;
+        result.distances = distances;
+        return result;
+    }
+
+private:
+    static size_t left(size_t limit, size_t used) {
+        return limit == 0 ? SIZE_MAX : (used < limit ? limit - used : 0);
+    }
+
+    QueryBudget budget;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace
+
+// Implementación de la función (r, c)-ANN Query
+std::pair<int, double> ann_query(
+    const float* q,
+    const DatasetView& dataset,
+    [[maybe_unused]] int K,  // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r,
+    double epsilon,
+    double beta,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh
+) {
+    const size_t n = dataset.size();
+    QueryScratch& scratch = thread_scratch();
+    CandidateSet& S = scratch.S;
+    std::vector<uint32_t>& Si = scratch.Si;
+    std::vector<uint32_t>& fresh = scratch.fresh;
+    S.reset();
+
+    // q se proyecta una sola vez en los L espacios
+    ProjectedQuery& projected = scratch.projected;
+    project_query(q, lsh, DETs, projected);
+    TopK top(1);
+
+    for (int i = 0; i < L; ++i) {
+
+        double r_prime = epsilon * r;
+        Si.clear();
+        flat_range_query(DETs[i], projected.q_prime(i), r_prime, Si);
+
+        // Solo los candidatos nuevos se miden contra el mejor hasta ahora
+        fresh.clear();
+        for (uint32_t id : Si) {
+            if (S.insert(id)) {
+                fresh.push_back(id);
+            }
+        }
+        rerank_into(q, dataset, fresh.data(), fresh.size(), top);
+
+        if (S.empty()) continue;
+        std::pair<int, double> best = to_neighbors(top.sorted())[0];
 
         // Si el tamaño de S es suficientemente grande, devolvemos el punto más cercano
         if (S.size() >= beta * n + 1) {
-            return *std::min_element(S.begin(), S.end(), [&q](const Point& a, const Point& b) {
-                return distance(a, q) < distance(b, q);
-            });
+            return best;
         }
 
         // Verificamos si existe un punto en S con distancia menor o igual a c * r
-        auto close_points = std::count_if(S.begin(), S.end(), [&q, c, r](const Point& p) {
-            return distance(p, q) <= c * r;
-        });
-
-        if (close_points >= 1) {
-            return *std::min_element(S.begin(), S.end(), [&q](const Point& a, const Point& b) {
-                return distance(a, q) < distance(b, q);
-            });
+        if (best.second <= c * r) {
+            return best;
         }
     }
 
-    return Point{}; 
+    return {-1, std::numeric_limits<double>::infinity()};
 }
-// Implementación del algoritmo c²-k-ANN Query
+// Cuerpo de c²-k-ANN con q ya proyectada en scratch.projected
+static QueryResult c2_k_search(
+    const float* q,
+    const DatasetView& dataset,
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const QueryBudget& budget,
+    QueryScratch& scratch
+) {
+    const size_t n = dataset.size();
+    CandidateSet& S = scratch.S;
+    std::vector<uint32_t>& Si = scratch.Si;
+    std::vector<uint32_t>& fresh = scratch.fresh;
+    S.reset();
+    double r = r_min;             // Inicializamos el radio
+
+    // Al crecer el radio cada árbol sigue desde su frontera, y cada
+    // candidato nuevo se mide una sola vez contra el top-k de la consulta
+    std::vector<RangeCursor>& cursors = reset_cursors(scratch, DETs, L);
+    TopK top(k);
+    BudgetTracker spent(budget);
+    StopReason reason;
 
+    while (true) {
+        for (int i = 0; i < L; ++i) {
+            // Realizamos la consulta DETRangeQuery, por tramos si hay
+            // límite de hojas o de tiempo
+            double r_prime = epsilon * r;
+            while (cursors[i].next_lower2() <= r_prime * r_prime) {
+                if (spent.exhausted(reason)) {
+                    return spent.finish(top, reason);
+                }
+                Si.clear();
+                spent.leaves += cursors[i].expand(r_prime, Si, nullptr, spent.leaf_slice());
 
-std::vector<Point> c2_k_ANN_Query(
-    const Point& q,       // Punto de consulta
-    int K,                // Número de características de los puntos
+                // Añadimos los puntos encontrados al conjunto S
+                fresh.clear();
+                for (uint32_t id : Si) {
+                    if (fresh.size() == spent.candidates_left()) {
+                        break;
+                    }
+                    if (S.insert(id)) {
+                        fresh.push_back(id);
+                    }
+                }
+                spent.candidates += fresh.size();
+                const size_t measured = std::min(fresh.size(), spent.distances_left());
+                rerank_into(q, dataset, fresh.data(), measured, top);
+                spent.distances += measured;
+
+                // Si el tamaño de S es suficientemente grande, devolvemos los puntos más cercanos
+                if (S.size() >= beta * n + k) {
+                    return spent.finish(top, StopReason::Completed);
+                }
+                if (spent.exhausted(reason)) {
+                    return spent.finish(top, reason);
+                }
+            }
+        }
+
+        // Hay k puntos de S dentro del radio escalado c * r si el k-ésimo
+        // más cercano lo está: basta con los k primeros
+        if (top.full() && (k == 0 || std::sqrt(static_cast<double>(top.worst())) <= c * r)) {
+            return spent.finish(top, StopReason::Completed);
+        }
+
+        // Sin nada más que abrir en ningún árbol, crecer el radio no agrega candidatos
+        bool remaining = false;
+        for (int i = 0; i < L; ++i) {
+            remaining = remaining || cursors[i].next_lower2() != std::numeric_limits<double>::infinity();
+        }
+        if (!remaining) {
+            return spent.finish(top, StopReason::Exhausted);
+        }
+
+        // Incrementamos el radio
+        r *= c;
+    }
+}
+
+// Implementación del algoritmo c²-k-ANN Query
+std::vector<std::pair<int, double>> c2_k_ANN_Query(
+    const float* q,       // Punto de consulta
+    const DatasetView& dataset,   // Dataset original
+    [[maybe_unused]] int K,  // Sin uso: K = lsh.get_K()
     int L,                // Número de árboles DET
-    int n,                // Número total de puntos
     double c,             // Factor de escalamiento del radio
     double r_min,         // Radio mínimo inicial
     double epsilon,       // Factor de escala para el radio
     double beta,          // Parámetro beta
     int k,                // Número de vecinos cercanos
-    const std::vector<TreeNode*>& DETs  // Índices de los DE-Trees
+    const std::vector<FlatDETree>& DETs,  // Índices de los DE-Trees
+    const LSH& lsh        // Funciones hash con las que se proyectó el dataset
 ) {
-    std::unordered_set<Point> S;  // Conjunto de candidatos
-    double r = r_min;             // Inicializamos el radio
+    return c2_k_ANN_Query(q, dataset, K, L, c, r_min, epsilon, beta, k, DETs, lsh, QueryBudget()).neighbors;
+}
 
-    while (true) {
-        for (int i = 0; i < L; ++i) {
-            // Proyección Hi sobre q
-            std::vector<int> q_prime = project_query(q, K);
-            std::vector<double> q_prime_double(q_prime.begin(), q_prime.end());
+QueryResult c2_k_ANN_Query(
+    const float* q,
+    const DatasetView& dataset,
+    [[maybe_unused]] int K,  // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    const QueryBudget& budget
+) {
+    // Proyección H1..HL sobre q, una sola vez para todos los radios
+    QueryScratch& scratch = thread_scratch();
+    project_query(q, lsh, DETs, scratch.projected);
+    return c2_k_search(q, dataset, L, c, r_min, epsilon, beta, k, DETs, budget, scratch);
+}
 
-            // Realizamos la consulta DETRangeQuery
-            double r_prime = epsilon * r;
-            std::vector<std::pair<Point, int>> Si = det_range_query(DETs[i], q_prime_double, r_prime, K);
+BatchResult c2_k_ANN_Query_batch(
+    const DatasetView& queries,
+    const DatasetView& dataset,
+    [[maybe_unused]] int K,  // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    ThreadPool& pool
+) {
+    // Las columnas de Y tienen las L·K proyecciones de lsh, como en project_query
+    const int lsh_K = lsh.get_K();
+    const int lsh_L = lsh.get_L();
+    if (DETs.size() < static_cast<size_t>(std::max(L, lsh_L))) {
+        throw std::invalid_argument("Se necesita un DE-Tree por espacio proyectado.");
+    }
+    if (queries.size() > 0 && queries.dim() != static_cast<size_t>(lsh.get_d())) {
+        throw std::invalid_argument("Las consultas no tienen la dimensión de las funciones hash.");
+    }
+    if (k < 0) {
+        throw std::invalid_argument("La cantidad de vecinos no puede ser negativa.");
+    }
+    auto start = std::chrono::high_resolution_clock::now();
 
-            // Añadimos los puntos encontrados al conjunto S
-            for (const auto& entry : Si) {
-                S.insert(entry.first);
+    const size_t nq = queries.size();
+    BatchResult result;
+    result.k = k;
+    result.nq = nq;
+    result.ids.assign(nq * k, -1);
+    result.distances.assign(nq * k, std::numeric_limits<double>::infinity());
+
+    // Bloques chicos: la proyección de un bloque sigue siendo un producto de
+    // matrices y el pool tiene bloques de sobra para repartir entre hilos
+    const size_t block_rows = 64;
+
+    ParallelStats stats = pool.parallel_for(nq, block_rows, [&](size_t q0, size_t q1) {
+        QueryScratch& scratch = thread_scratch();
+        thread_local Eigen::MatrixXf Y;
+
+        // Columna t de Y: las L·K proyecciones de la consulta q0 + t
+        lsh.project_tile(queries.slice(q0, q1), Y);
+        for (size_t qi = q0; qi < q1; ++qi) {
+            encode_projection(Y.col(qi - q0).data(), lsh_K, lsh_L, DETs, scratch.projected);
+            std::vector<std::pair<int, double>> neighbors =
+                c2_k_search(queries.row(qi), dataset, L, c, r_min, epsilon, beta, k, DETs, QueryBudget(), scratch).neighbors;
+            for (size_t t = 0; t < neighbors.size(); ++t) {
+                result.ids[qi * k + t] = neighbors[t].first;
+                result.distances[qi * k + t] = neighbors[t].second;
             }
+        }
+    });
 
-            // Si el tamaño de S es suficientemente grande, devolvemos los puntos más cercanos
-            if (S.size() >= beta * n + k) {
-                std::vector<Point> closest_points;
-                for (const auto& point : S) {
-                    closest_points.push_back(point);
-                }
-                std::sort(closest_points.begin(), closest_points.end(), [&q](const Point& a, const Point& b) {
-                    return distance(a, q) < distance(b, q);
-                });
-                closest_points.resize(k); // Tomamos los k más cercanos
-                return closest_points;
+    auto stop = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    std::cout << "Batch queries: " << nq << " queries in " << duration.count() << " microseconds ("
+              << stats.threads << " threads, utilization " << stats.utilization() << "x)" << std::endl;
+
+    return result;
+}
+
+namespace {
+
+// Entrada de la cola de best_first_knn: un nodo o un punto de un árbol
+struct BestFirstEntry {
+    double lower2;   // Cota inferior al cuadrado en el espacio del árbol
+    uint32_t ref;    // Nodo, o id si point
+    uint16_t tree;
+    bool point;
+
+    bool operator>(const BestFirstEntry& other) const { return lower2 > other.lower2; }
+};
+
+} // namespace
+
+QueryResult best_first_knn(
+    const float* q,
+    const DatasetView& dataset,
+    int L,
+    double epsilon,
+    int k,
+    const QueryBudget& budget,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh
+) {
+    // Sin vecinos que buscar no hay nada que abrir (y TopK(0) ya está lleno)
+    if (k <= 0) {
+        return QueryResult();
+    }
+
+    QueryScratch& scratch = thread_scratch();
+    CandidateSet& S = scratch.S;
+    S.reset();
+    project_query(q, lsh, DETs, scratch.projected);
+
+    std::vector<QueryBounds>& bounds = scratch.bounds;
+    if (bounds.size() < static_cast<size_t>(L)) {
+        bounds.resize(L);
+    }
+    std::vector<BestFirstEntry> queue;
+    for (int i = 0; i < L; ++i) {
+        const FlatDETree& tree = DETs[i];
+        bounds[i].reset(tree.bounds(), scratch.projected.q_prime(i));
+        for (uint32_t c = 0; c < tree.root_children(); ++c) {
+            const uint8_t* box = tree.box(c);
+            const double lower2 = bounds[i].lower2(box, box + tree.dims());
+            if (lower2 != std::numeric_limits<double>::infinity()) {   // Hijos vacíos
+                queue.push_back({lower2, c, static_cast<uint16_t>(i), false});
             }
         }
+    }
+    std::make_heap(queue.begin(), queue.end(), std::greater<BestFirstEntry>());
+
+    const double epsilon2 = epsilon * epsilon;
+    const size_t d = dataset.dim();
+    TopK top(k);
+    BudgetTracker spent(budget);
+    StopReason reason;
+    size_t pops = 0;
 
-        // Verificamos si existe un punto en S dentro del radio escalado c * r
-        std::vector<Point> valid_points;
-        for (const auto& o : S) {
-            if (distance(o, q) <= c * r) {
-                valid_points.push_back(o);
+    while (!queue.empty()) {
+        // Los k vecinos quedan confirmados cuando nada de la cola puede
+        // estar más cerca, según la relación r' = epsilon · r
+        const BestFirstEntry entry = queue.front();
+        if (top.full() && entry.lower2 > epsilon2 * top.worst()) {
+            return spent.finish(top, StopReason::Completed);
+        }
+        if (spent.exhausted(reason, (pops++ % BudgetTracker::LEAF_SLICE) == 0)) {
+            return spent.finish(top, reason);
+        }
+        std::pop_heap(queue.begin(), queue.end(), std::greater<BestFirstEntry>());
+        queue.pop_back();
+
+        if (entry.point) {
+            if (S.insert(entry.ref)) {
+                top.push(squared_l2(q, dataset.row(entry.ref), d), entry.ref);
+                spent.candidates++;
+                spent.distances++;
             }
+            continue;
         }
 
-        // Si hay suficientes puntos válidos, devolvemos los k más cercanos
-        if (valid_points.size() >= k) {
-            std::sort(valid_points.begin(), valid_points.end(), [&q](const Point& a, const Point& b) {
-                return distance(a, q) < distance(b, q);
-            });
-            valid_points.resize(k); // Tomamos los k más cercanos
-            return valid_points;
+        const FlatDETree& tree = DETs[entry.tree];
+        const QueryBounds& qb = bounds[entry.tree];
+        const FlatNode& node = tree.node(entry.ref);
+        if (!node.is_leaf()) {
+            for (uint32_t child = node.first; child <= node.first + 1; ++child) {
+                const uint8_t* box = tree.box(child);
+                queue.push_back({qb.lower2(box, box + tree.dims()), child, entry.tree, false});
+                std::push_heap(queue.begin(), queue.end(), std::greater<BestFirstEntry>());
+            }
+            continue;
         }
 
-        // Incrementamos el radio
-        r *= c;
+        // Los puntos de la hoja entran con la cota de su propia región
+        spent.leaves++;
+        const uint32_t* ids = tree.leaf_ids(node);
+        const uint64_t* codes = tree.leaf_codes(node);
+        for (uint32_t t = 0; t < node.count; ++t) {
+            if (S.contains(ids[t])) {
+                continue;
+            }
+            const double lower2 = qb.point_lower2(codes + size_t(t) * tree.words_per_row(), tree.bits());
+            queue.push_back({lower2, ids[t], entry.tree, true});
+            std::push_heap(queue.begin(), queue.end(), std::greater<BestFirstEntry>());
+        }
+    }
+
+    return spent.finish(top, StopReason::Exhausted);
+}
+
+namespace {
+
+// Top-k de la consulta a partir del de cada árbol. Los ids de fresh[i] no se
+// repiten entre árboles, así que basta con juntar los k mejores de cada uno
+TopK merge_tops(const std::vector<TopK>& tops, size_t k) {
+    TopK top(k);
+    for (const TopK& tree_top : tops) {
+        for (const TopK::Entry& entry : tree_top.sorted()) {
+            top.push(entry.first, entry.second);
+        }
     }
+    return top;
+}
+
+// Lleva los L árboles en paralelo hasta el radio r_prime, cada uno desde su
+// cursor. Después de agregar los candidatos del árbol i, done(i, first, size)
+// decide si la consulta ya terminó; first es donde empiezan en fresh[i] los
+// ids nuevos de esta pasada.
+template <typename Done>
+void parallel_round(std::vector<RangeCursor>& cursors, int L,
+                    double r_prime, SharedCandidates& S, ThreadPool& pool, Done done) {
+    pool.parallel_for(L, 1, [&](size_t begin, size_t end) {
+        thread_local std::vector<uint32_t> Si;
+        for (size_t i = begin; i < end; ++i) {
+            if (S.stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            Si.clear();
+            cursors[i].expand(r_prime, Si, &S.stop);
+            const size_t first = S.fresh[i].size();
+            const size_t size = S.merge(i, Si);
+            if (done(i, first, size)) {
+                S.stop.store(true, std::memory_order_relaxed);
+            }
+        }
+    });
+}
+
+} // namespace
+
+std::pair<int, double> ann_query_parallel(
+    const float* q,
+    const DatasetView& dataset,
+    [[maybe_unused]] int K,  // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r,
+    double epsilon,
+    double beta,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    ThreadPool& pool
+) {
+    const size_t n = dataset.size();
+    QueryScratch& scratch = thread_scratch();
+    project_query(q, lsh, DETs, scratch.projected);
+
+    SharedCandidates& S = scratch.shared;
+    S.reset(n, L);
+    std::vector<RangeCursor>& cursors = reset_cursors(scratch, DETs, L);
 
-    return {};  // Retorna vacío si no encuentra los puntos más cercanos
-}
\ No newline at end of file
+    // Cada árbol mide sus candidatos nuevos una sola vez, en su propio hilo,
+    // y guarda el más cercano; al final se juntan los L
+    std::vector<TopK> best(L, TopK(1));
+    parallel_round(cursors, L, epsilon * r, S, pool, [&](int i, size_t first, size_t size) {
+        rerank_into(q, dataset, S.fresh[i].data() + first, S.fresh[i].size() - first, best[i]);
+        if (size >= beta * n + 1) {
+            return true;
+        }
+        // Basta con que un árbol encuentre un punto a distancia <= c * r
+        return best[i].full() && std::sqrt(static_cast<double>(best[i].worst())) <= c * r;
+    });
+
+    std::vector<std::pair<int, double>> closest = to_neighbors(merge_tops(best, 1).sorted());
+    if (closest.empty()) {
+        return {-1, std::numeric_limits<double>::infinity()};
+    }
+    if (S.stop.load() || closest[0].second <= c * r) {
+        return closest[0];
+    }
+    return {-1, std::numeric_limits<double>::infinity()};
+}
+
+std::vector<std::pair<int, double>> c2_k_ANN_Query_parallel(
+    const float* q,
+    const DatasetView& dataset,
+    [[maybe_unused]] int K,  // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    ThreadPool& pool
+) {
+    const size_t n = dataset.size();
+    QueryScratch& scratch = thread_scratch();
+    project_query(q, lsh, DETs, scratch.projected);
+
+    SharedCandidates& S = scratch.shared;
+    S.reset(n, L);
+    std::vector<RangeCursor>& cursors = reset_cursors(scratch, DETs, L);
+    double r = r_min;
+
+    // Cada candidato se mide una vez, en el hilo del árbol que lo agregó:
+    // tops[i] es el top-k de fresh[i] y se mantiene entre radios
+    std::vector<TopK> tops(L, TopK(k));
+
+    while (true) {
+        parallel_round(cursors, L, epsilon * r, S, pool, [&](int i, size_t first, size_t size) {
+            rerank_into(q, dataset, S.fresh[i].data() + first, S.fresh[i].size() - first, tops[i]);
+            return size >= beta * n + k;
+        });
+
+        // Algún árbol juntó beta·n + k candidatos: los demás ya se cortaron
+        std::vector<std::pair<int, double>> closest = to_neighbors(merge_tops(tops, k).sorted());
+        if (S.stop.load()) {
+            return closest;
+        }
+
+        if (closest.size() == static_cast<size_t>(k) && (k == 0 || closest.back().second <= c * r)) {
+            return closest;
+        }
+
+        // Árboles recorridos completos: crecer el radio no agrega candidatos
+        bool remaining = false;
+        for (int i = 0; i < L; ++i) {
+            remaining = remaining || cursors[i].next_lower2() != std::numeric_limits<double>::infinity();
+        }
+        if (!remaining) {
+            return closest;
+        }
+
+        r *= c;
+    }
+}
@@ -2,33 +2,200 @@
 #ifndef ANN_QUERY_H
 #define ANN_QUERY_H
 
+#include <chrono>
 #include <vector>
+#include <utility>
 #include "point.h"
-#include "tree_node.h"
+#include "flat_tree.h"
+#include "dataset.h"
+#include "LSH.h"
+
+// Consulta proyectada en los L espacios: q' y su código en cada árbol, en
+// dos bloques [L][K]. Se puede reusar entre consultas sin volver a reservar.
+struct ProjectedQuery {
+    int K = 0;
+    int L = 0;
+    std::vector<double> values;   // q' de cada espacio
+    std::vector<uint8_t> codes;   // Región de q' en cada dimensión
+    std::vector<float> projected; // Salida en float de la proyección, antes de convertir
+
+    const double* q_prime(int i) const { return values.data() + size_t(i) * K; }
+    const uint8_t* code(int i) const { return codes.data() + size_t(i) * K; }
+};
+
+// Límites de una consulta; 0 = sin límite. Al llegar a cualquiera, la
+// consulta devuelve el mejor top-k encontrado hasta ese momento.
+struct QueryBudget {
+    size_t max_candidates = 0;              // Ids distintos juntados
+    size_t max_leaves = 0;                  // Hojas abiertas, sumando los L árboles
+    size_t max_distances = 0;               // Distancias exactas calculadas
+    std::chrono::microseconds deadline{0};  // Tiempo desde el inicio de la consulta
+};
+
+// Por qué terminó una consulta
+enum class StopReason {
+    Completed,    // Se cumplió la condición de término del algoritmo
+    Exhausted,    // Se recorrieron los árboles completos sin cumplirla
+    Candidates,   // Límites de QueryBudget
+    Leaves,
+    Distances,
+    Deadline
+};
+
+const char* stop_reason_name(StopReason reason);
+
+// Vecinos {posición, distancia} ordenados por distancia, el motivo de
+// término y lo que costó la consulta
+struct QueryResult {
+    std::vector<std::pair<int, double>> neighbors;
+    StopReason stop = StopReason::Completed;
+    size_t candidates = 0;
+    size_t leaves = 0;
+    size_t distances = 0;
+};
+
+// Proyecta q con las L·K funciones hash de lsh (un producto matriz-vector)
+// y codifica cada espacio con los breakpoints del árbol correspondiente
+void project_query(const float* q, const LSH& lsh, const std::vector<FlatDETree>& DETs, ProjectedQuery& out);
+
+// Igual, a partir de las L·K proyecciones ya calculadas (una columna de
+// LSH::project_tile)
+void encode_projection(const float* projected, int K, int L, const std::vector<FlatDETree>& DETs, ProjectedQuery& out);
+
+// Resultado de una consulta por lotes: matriz k × nq de {posición, distancia}
+// en la que los k vecinos de cada consulta son contiguos. Si una consulta
+// tiene menos de k vecinos, el resto queda en {-1, inf}.
+struct BatchResult {
+    size_t k = 0;
+    size_t nq = 0;
+    std::vector<int> ids;
+    std::vector<double> distances;
+
+    int neighbor_id(size_t qi, size_t t) const { return ids[qi * k + t]; }
+    double neighbor_distance(size_t qi, size_t t) const { return distances[qi * k + t]; }
+};
 
 // Función para realizar la consulta (r, c)-ANN
-Point ann_query(
-    const Point& q, 
-    int K, 
+// Devuelve {posición, distancia} del punto encontrado, o {-1, inf} si no hay ninguno.
+// K se toma de lsh; el parámetro queda solo por compatibilidad y se ignora
+// (igual en c2_k_ANN_Query).
+std::pair<int, double> ann_query(
+    const float* q,               // Punto de consulta (dimensión dataset.dim())
+    const DatasetView& dataset,   // Dataset original para la distancia exacta
+    int K,                        // Sin uso: K = lsh.get_K()
     int L, 
-    int n, 
     double c, 
     double r, 
     double epsilon, 
     double beta, 
-    const std::vector<TreeNode*>& DETs
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh                // Funciones hash con las que se proyectó el dataset
 );
-std::vector<Point> c2_k_ANN_Query(
-    const Point& q,       // Punto de consulta
-    int K,                // Número de características de los puntos
+
+// Devuelve los k vecinos como pares {posición, distancia}, ordenados por distancia
+std::vector<std::pair<int, double>> c2_k_ANN_Query(
+    const float* q,               // Punto de consulta
+    const DatasetView& dataset,   // Dataset original para la distancia exacta
+    int K,                // Sin uso: K = lsh.get_K()
     int L,                // Número de árboles DET
-    int n,                // Número total de puntos
     double c,             // Factor de escalamiento del radio
     double r_min,         // Radio mínimo inicial
     double epsilon,       // Factor de escala para el radio
     double beta,          // Parámetro beta
     int k,                // Número de vecinos cercanos
-    const std::vector<TreeNode*>& DETs  // Índices de los DE-Trees
+    const std::vector<FlatDETree>& DETs,  // Índices de los DE-Trees
+    const LSH& lsh        // Funciones hash con las que se proyectó el dataset
+);
+
+// c²-k-ANN con límites: si se agota alguno del budget antes de terminar,
+// devuelve el mejor top-k hasta ahí y en `stop` cuál fue
+QueryResult c2_k_ANN_Query(
+    const float* q,
+    const DatasetView& dataset,
+    int K,                        // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    const QueryBudget& budget
+);
+
+// c²-k-ANN para todas las filas de `queries`. Cada bloque de consultas se
+// proyecta con un solo producto de matrices y los bloques se reparten entre
+// los hilos del pool (con robo de trabajo). Cada hilo reusa su memoria de
+// trabajo entre consultas. El resultado de cada consulta es el de c2_k_ANN_Query.
+// Lanza invalid_argument si las consultas no tienen dimensión lsh.get_d() o si k < 0.
+BatchResult c2_k_ANN_Query_batch(
+    const DatasetView& queries,   // nq consultas, una por fila
+    const DatasetView& dataset,
+    int K,                        // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    ThreadPool& pool = ThreadPool::shared()
+);
+
+// k-NN por mejor primero, sin radio inicial: una sola cola de prioridad
+// con (cota inferior, árbol, nodo o punto) de los L DE-Trees. Siempre se
+// abre la entrada con menor cota; un punto que sale de la cola se mide con
+// la distancia exacta. Termina cuando hay k vecinos y la siguiente cota
+// pasa de (epsilon · distancia del k-ésimo)², la misma relación entre
+// radios que usa c2_k_ANN_Query, o cuando se agota el budget. Con k <= 0
+// devuelve un resultado vacío sin recorrer nada.
+QueryResult best_first_knn(
+    const float* q,
+    const DatasetView& dataset,
+    int L,
+    double epsilon,
+    int k,
+    const QueryBudget& budget,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh
+);
+
+// Versiones paralelas para latencia de una sola consulta: los L árboles se
+// recorren a la vez en el pool. Cada árbol guarda en su propio buffer los
+// ids que ningún otro vio antes (un bitmap atómico hace de S) y los mide en
+// su propio top-k mientras revisa la condición de término; cuando uno la
+// cumple se cortan los recorridos de todos, y el resultado junta los L
+// top-k. Si el corte no llega, S y el resultado son los de la versión
+// secuencial.
+std::pair<int, double> ann_query_parallel(
+    const float* q,
+    const DatasetView& dataset,
+    int K,                        // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r,
+    double epsilon,
+    double beta,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    ThreadPool& pool = ThreadPool::shared()
+);
+
+std::vector<std::pair<int, double>> c2_k_ANN_Query_parallel(
+    const float* q,
+    const DatasetView& dataset,
+    int K,                        // Sin uso: K = lsh.get_K()
+    int L,
+    double c,
+    double r_min,
+    double epsilon,
+    double beta,
+    int k,
+    const std::vector<FlatDETree>& DETs,
+    const LSH& lsh,
+    ThreadPool& pool = ThreadPool::shared()
 );
 
 
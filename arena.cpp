@@ -0,0 +1,65 @@
+#include "arena.h"
+#include <cstdlib>
+
+Arena::Arena(size_t block_size) : block_size(block_size) {}
+
+Arena::~Arena() {
+    release();
+}
+
+Arena::Arena(Arena&& other) noexcept
+    : block_size(other.block_size), head(other.head), cursor(other.cursor), limit(other.limit),
+      reserved(other.reserved), used(other.used) {
+    other.head = nullptr;
+    other.cursor = other.limit = nullptr;
+    other.reserved = other.used = 0;
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        release();
+        block_size = other.block_size;
+        head = other.head;
+        cursor = other.cursor;
+        limit = other.limit;
+        reserved = other.reserved;
+        used = other.used;
+        other.head = nullptr;
+        other.cursor = other.limit = nullptr;
+        other.reserved = other.used = 0;
+    }
+    return *this;
+}
+
+void* Arena::allocate(size_t bytes, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t(align) - 1);
+    if (cursor == nullptr || p + bytes > reinterpret_cast<uintptr_t>(limit)) {
+        // Bloque nuevo; los pedidos más grandes que un bloque van solos
+        const size_t header = (sizeof(Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        size_t size = header + (bytes + align > block_size ? bytes + align : block_size);
+        Block* block = static_cast<Block*>(std::malloc(size));
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        block->next = head;
+        block->size = size;
+        head = block;
+        reserved += size;
+        cursor = reinterpret_cast<char*>(block) + header;
+        limit = reinterpret_cast<char*>(block) + size;
+        p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t(align) - 1);
+    }
+    cursor = reinterpret_cast<char*>(p + bytes);
+    used += bytes;
+    return reinterpret_cast<void*>(p);
+}
+
+void Arena::release() {
+    while (head != nullptr) {
+        Block* next = head->next;
+        std::free(head);
+        head = next;
+    }
+    cursor = limit = nullptr;
+    reserved = used = 0;
+}
@@ -0,0 +1,58 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Arena monotónico: reparte memoria de bloques grandes y nunca libera
+// objetos sueltos; release() (o el destructor) devuelve todos los bloques
+// de una vez. Sólo guarda objetos sin destructor, que pueden abandonarse.
+class Arena {
+public:
+    explicit Arena(size_t block_size = size_t(1) << 20);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Arreglo sin inicializar de `count` elementos
+    template <typename T>
+    T* allocate_array(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Libera todos los bloques
+    void release();
+
+    size_t bytes_reserved() const { return reserved; }  // Pedidos al sistema
+    size_t bytes_used() const { return used; }          // Entregados por allocate
+
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    size_t block_size;
+    Block* head = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t reserved = 0;
+    size_t used = 0;
+};
+
+#endif // ARENA_H
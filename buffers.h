@@ -0,0 +1,86 @@
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Vista [L][K][n] (column-major): para cada espacio i y dimensión j,
+// los n valores de la columna son contiguos. La usa la selección de
+// breakpoints, que recorre columnas completas.
+template <typename T>
+struct ColumnMajorView {
+    T* data = nullptr;
+    size_t L = 0, K = 0, n = 0;
+
+    T* column(size_t i, size_t j) const { return data + (i * K + j) * n; }
+    T& at(size_t i, size_t idx, size_t j) const { return column(i, j)[idx]; }
+};
+
+// Vista [L][n][K] (row-major): las K coordenadas de un punto en el
+// espacio i son contiguas. La usa la inserción en los DE-Trees.
+template <typename T>
+struct RowMajorView {
+    T* data = nullptr;
+    size_t L = 0, n = 0, K = 0;
+
+    T* row(size_t i, size_t idx) const { return data + (i * n + idx) * K; }
+    T& at(size_t i, size_t idx, size_t j) const { return row(i, idx)[j]; }
+};
+
+// Proyecciones de los n puntos en los L espacios, en una sola reserva [L][K][n]
+class ProjectionBuffer {
+public:
+    ProjectionBuffer() = default;
+    ProjectionBuffer(size_t L, size_t K, size_t n) : L(L), K(K), n(n), values(L * K * n) {}
+
+    size_t spaces() const { return L; }
+    size_t dims() const { return K; }
+    size_t size() const { return n; }
+
+    ColumnMajorView<float> columns() { return {values.data(), L, K, n}; }
+    ColumnMajorView<const float> columns() const { return {values.data(), L, K, n}; }
+
+    float* column(size_t i, size_t j) { return columns().column(i, j); }
+    const float* column(size_t i, size_t j) const { return columns().column(i, j); }
+    float at(size_t i, size_t idx, size_t j) const { return columns().at(i, idx, j); }
+
+    bool operator==(const ProjectionBuffer& other) const {
+        return L == other.L && K == other.K && n == other.n && values == other.values;
+    }
+
+private:
+    size_t L = 0, K = 0, n = 0;
+    std::vector<float> values;
+};
+
+// Códigos de región de los n puntos en los L espacios, en una sola reserva [L][n][K]
+class CodeBuffer {
+public:
+    using code_type = uint8_t;  // Nr <= 256 regiones
+
+    CodeBuffer() = default;
+    CodeBuffer(size_t L, size_t n, size_t K) : L(L), n(n), K(K), codes(L * n * K, 0) {}
+
+    size_t spaces() const { return L; }
+    size_t size() const { return n; }
+    size_t dims() const { return K; }
+
+    RowMajorView<code_type> rows() { return {codes.data(), L, n, K}; }
+    RowMajorView<const code_type> rows() const { return {codes.data(), L, n, K}; }
+
+    code_type* row(size_t i, size_t idx) { return rows().row(i, idx); }
+    const code_type* row(size_t i, size_t idx) const { return rows().row(i, idx); }
+    code_type& at(size_t i, size_t idx, size_t j) { return rows().at(i, idx, j); }
+    code_type at(size_t i, size_t idx, size_t j) const { return rows().at(i, idx, j); }
+
+    bool operator==(const CodeBuffer& other) const {
+        return L == other.L && K == other.K && n == other.n && codes == other.codes;
+    }
+
+private:
+    size_t L = 0, n = 0, K = 0;
+    std::vector<code_type> codes;
+};
+
+#endif // BUFFERS_H
@@ -0,0 +1,59 @@
+#ifndef CANDIDATE_SET_H
+#define CANDIDATE_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Conjunto de candidatos de una consulta, indexado por id de punto. Cada id
+// tiene un sello con la época en que se agregó: reset() solo avanza la
+// época, así que vaciar el conjunto entre consultas cuesta O(1) y la
+// memoria se reusa. Los ids quedan además en un vector plano, en el orden
+// en que llegaron. No es seguro entre hilos: se usa uno por hilo.
+class CandidateSet {
+public:
+    // Vacía el conjunto sin tocar los sellos (salvo cuando la época da la vuelta)
+    void reset() {
+        ids.clear();
+        if (++epoch == 0) {
+            stamps.assign(stamps.size(), 0);
+            epoch = 1;
+        }
+    }
+
+    // Agrega id si no estaba; devuelve si era nuevo. Los sellos crecen
+    // solos hasta el mayor id visto
+    bool insert(uint32_t id) {
+        if (id >= stamps.size()) {
+            stamps.resize(size_t(id) + 1, 0);
+        }
+        if (stamps[id] == epoch) {
+            return false;
+        }
+        stamps[id] = epoch;
+        ids.push_back(id);
+        return true;
+    }
+
+    template <typename It>
+    void insert(It first, It last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    bool contains(uint32_t id) const { return id < stamps.size() && stamps[id] == epoch; }
+    size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+
+    const std::vector<uint32_t>& items() const { return ids; }
+    std::vector<uint32_t>::const_iterator begin() const { return ids.begin(); }
+    std::vector<uint32_t>::const_iterator end() const { return ids.end(); }
+
+private:
+    std::vector<uint32_t> stamps;  // Época en que se agregó cada id
+    std::vector<uint32_t> ids;     // Candidatos de la época actual
+    uint32_t epoch = 1;
+};
+
+#endif // CANDIDATE_SET_H
@@ -0,0 +1,64 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Generador basado en contador (Philox4x32-10, Salmon et al. 2011).
+// Cada valor depende solo de (semilla, contador), así que cualquier hilo
+// puede generar cualquier parte de la secuencia sin estado compartido y
+// el resultado no depende del orden ni del número de hilos.
+class Philox4x32 {
+public:
+    using Block = std::array<uint32_t, 4>;
+
+    explicit Philox4x32(uint64_t seed)
+        : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)} {}
+
+    // Cuatro palabras aleatorias para el contador de 128 bits (hi, lo)
+    Block operator()(uint64_t hi, uint64_t lo) const {
+        Block ctr = {static_cast<uint32_t>(lo), static_cast<uint32_t>(lo >> 32),
+                     static_cast<uint32_t>(hi), static_cast<uint32_t>(hi >> 32)};
+        std::array<uint32_t, 2> k = key;
+        for (int round = 0; round < 10; ++round) {
+            ctr = single_round(ctr, k);
+            k[0] += 0x9E3779B9u;
+            k[1] += 0xBB67AE85u;
+        }
+        return ctr;
+    }
+
+    // Uniforme en (0, 1) con 53 bits a partir de dos palabras
+    static double to_unit(uint32_t hi, uint32_t lo) {
+        uint64_t bits = (static_cast<uint64_t>(hi) << 21) ^ (lo >> 11);
+        return (static_cast<double>(bits & ((uint64_t(1) << 53) - 1)) + 0.5) / 9007199254740992.0;
+    }
+
+    // Dos normales estándar independientes por contador (Box-Muller)
+    std::array<double, 2> normal_pair(uint64_t hi, uint64_t lo) const {
+        Block r = (*this)(hi, lo);
+        double u1 = to_unit(r[0], r[1]);
+        double u2 = to_unit(r[2], r[3]);
+        double radius = std::sqrt(-2.0 * std::log(u1));
+        double angle = 6.283185307179586 * u2;
+        return {radius * std::cos(angle), radius * std::sin(angle)};
+    }
+
+    double uniform(uint64_t hi, uint64_t lo) const {
+        Block r = (*this)(hi, lo);
+        return to_unit(r[0], r[1]);
+    }
+
+private:
+    std::array<uint32_t, 2> key;
+
+    static Block single_round(const Block& ctr, const std::array<uint32_t, 2>& k) {
+        const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+        const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+        return {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k[0], static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k[1], static_cast<uint32_t>(p0)};
+    }
+};
+
+#endif // COUNTER_RNG_H
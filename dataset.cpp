@@ -0,0 +1,135 @@
+#include "dataset.h"
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+float* aligned_allocate(size_t bytes) {
+    if (bytes == 0) return nullptr;
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(bytes, DatasetStore::ALIGNMENT);
+#else
+    void* ptr = std::aligned_alloc(DatasetStore::ALIGNMENT, bytes);
+#endif
+    if (ptr == nullptr) {
+        throw bad_alloc();
+    }
+    return static_cast<float*>(ptr);
+}
+
+void aligned_free(float* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+} // namespace
+
+DatasetStore::DatasetStore(size_t n, size_t d) : n(n), d(d) {
+    const size_t floats_per_line = ALIGNMENT / sizeof(float);
+    stride = (d + floats_per_line - 1) / floats_per_line * floats_per_line;
+    buffer = aligned_allocate(n * stride * sizeof(float));
+    // El relleno queda en cero para que los kernels puedan leer filas completas
+    if (buffer != nullptr) {
+        memset(buffer, 0, n * stride * sizeof(float));
+    }
+}
+
+DatasetStore::~DatasetStore() {
+    release();
+}
+
+DatasetStore::DatasetStore(DatasetStore&& other) noexcept
+    : buffer(other.buffer), n(other.n), d(other.d), stride(other.stride) {
+    other.buffer = nullptr;
+    other.n = other.d = other.stride = 0;
+}
+
+DatasetStore& DatasetStore::operator=(DatasetStore&& other) noexcept {
+    if (this != &other) {
+        release();
+        buffer = other.buffer;
+        n = other.n;
+        d = other.d;
+        stride = other.stride;
+        other.buffer = nullptr;
+        other.n = other.d = other.stride = 0;
+    }
+    return *this;
+}
+
+void DatasetStore::release() {
+    aligned_free(buffer);
+    buffer = nullptr;
+}
+
+DatasetStore read_fvecs_store(const string& filename) {
+    ifstream file(filename, ios::binary | ios::ate);
+    if (!file.is_open()) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+
+    const size_t file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+    if (file_size == 0) {
+        return DatasetStore();
+    }
+
+    int32_t d = 0;
+    file.read(reinterpret_cast<char*>(&d), sizeof(int32_t));
+    if (!file || d <= 0) {
+        throw runtime_error("Invalid fvecs header in " + filename);
+    }
+
+    // Todas las filas tienen el mismo tamaño: cabecera + d floats
+    const size_t row_bytes = sizeof(int32_t) + d * sizeof(float);
+    if (file_size % row_bytes != 0) {
+        throw runtime_error("Truncated fvecs file: " + filename);
+    }
+    const size_t n = file_size / row_bytes;
+
+    DatasetStore store(n, d);
+    file.seekg(0);
+    for (size_t i = 0; i < n; ++i) {
+        int32_t length = 0;
+        file.read(reinterpret_cast<char*>(&length), sizeof(int32_t));
+        if (length != d) {
+            throw runtime_error("Inconsistent dimension in " + filename);
+        }
+        file.read(reinterpret_cast<char*>(store.row(i)), d * sizeof(float));
+        if (!file) {
+            throw runtime_error("Error reading data from file.");
+        }
+    }
+
+    return store;
+}
+
+DatasetStore to_dataset_store(const vector<Eigen::VectorXd>& dataset) {
+    if (dataset.empty()) return DatasetStore();
+
+    DatasetStore store(dataset.size(), dataset[0].size());
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        Eigen::Map<Eigen::VectorXf>(store.row(i), store.dim()) = dataset[i].cast<float>();
+    }
+    return store;
+}
+
+DatasetStore to_dataset_store(const BvecsView& dataset) {
+    DatasetStore store(dataset.size(), dataset.dim());
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        const uint8_t* src = dataset.row(i);
+        float* dst = store.row(i);
+        for (size_t j = 0; j < dataset.dim(); ++j) {
+            dst[j] = static_cast<float>(src[j]);
+        }
+    }
+    return store;
+}
@@ -0,0 +1,91 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Eigen/Dense"
+
+// Vista no propietaria sobre un dataset row-major de elementos T.
+// Las filas se separan por `stride` elementos (>= d), así que la misma vista
+// sirve para buffers alineados y para filas intercaladas con cabeceras
+// (por ejemplo un archivo .fvecs mapeado en memoria).
+template <typename T>
+struct BasicDatasetView {
+    using Vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+
+    const T* data = nullptr;
+    size_t n = 0;       // Número de filas
+    size_t d = 0;       // Dimensión de cada fila
+    size_t stride = 0;  // Distancia entre filas consecutivas (en elementos)
+
+    BasicDatasetView() = default;
+    BasicDatasetView(const T* data, size_t n, size_t d, size_t stride)
+        : data(data), n(n), d(d), stride(stride) {}
+
+    size_t size() const { return n; }
+    size_t dim() const { return d; }
+
+    const T* row(size_t i) const { return data + i * stride; }
+
+    // Acceso sin copia a una fila como vector de Eigen
+    Eigen::Map<const Vector> row_map(size_t i) const {
+        return Eigen::Map<const Vector>(row(i), d);
+    }
+
+    // Subconjunto de filas [begin, end)
+    BasicDatasetView slice(size_t begin, size_t end) const {
+        return BasicDatasetView(row(begin), end - begin, d, stride);
+    }
+};
+
+using DatasetView = BasicDatasetView<float>;      // .fvecs / DatasetStore
+using IvecsView = BasicDatasetView<int32_t>;      // .ivecs (ground truth)
+using BvecsView = BasicDatasetView<uint8_t>;      // .bvecs (SIFT1B)
+
+// Dueño de un único buffer float32 alineado a 64 bytes.
+// El stride se redondea a múltiplos de 16 floats para que cada fila
+// empiece en una línea de caché.
+class DatasetStore {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    DatasetStore() = default;
+    DatasetStore(size_t n, size_t d);
+    ~DatasetStore();
+
+    DatasetStore(const DatasetStore&) = delete;
+    DatasetStore& operator=(const DatasetStore&) = delete;
+    DatasetStore(DatasetStore&& other) noexcept;
+    DatasetStore& operator=(DatasetStore&& other) noexcept;
+
+    size_t size() const { return n; }
+    size_t dim() const { return d; }
+    size_t row_stride() const { return stride; }
+    size_t bytes() const { return n * stride * sizeof(float); }
+
+    float* row(size_t i) { return buffer + i * stride; }
+    const float* row(size_t i) const { return buffer + i * stride; }
+
+    DatasetView view() const { return DatasetView(buffer, n, d, stride); }
+
+private:
+    float* buffer = nullptr;
+    size_t n = 0;
+    size_t d = 0;
+    size_t stride = 0;
+
+    void release();
+};
+
+// Lee un archivo .fvecs directamente al buffer contiguo (sin pasar por double)
+DatasetStore read_fvecs_store(const std::string& filename);
+
+// Copia un dataset de Eigen al formato contiguo
+DatasetStore to_dataset_store(const std::vector<Eigen::VectorXd>& dataset);
+
+// Convierte filas uint8 (.bvecs) a float32 alineado
+DatasetStore to_dataset_store(const BvecsView& dataset);
+
+#endif // DATASET_H
@@ -0,0 +1,93 @@
+#include "encode_kernel.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Breakpoints internos en float. La comparación da lo mismo que contra los
+// double originales solo porque tanto los valores como los breakpoints son
+// proyecciones con floor ya aplicado: enteros de magnitud < 2^24, que el
+// paso a float no redondea. Con breakpoints no enteros (p. ej. promedios de
+// la muestra) un valor igual a floor(B[r]) podría cambiar de región.
+int inner_breakpoints(const double* B, int Nr, float* inner) {
+    for (int r = 1; r < Nr; ++r) {
+        inner[r - 1] = static_cast<float>(B[r]);
+    }
+    return Nr - 1;
+}
+
+inline uint8_t region_of(float value, const float* inner, int count) {
+    int region = 0;
+    for (int r = 0; r < count; ++r) {
+        region += inner[r] <= value;
+    }
+    return static_cast<uint8_t>(region);
+}
+
+} // namespace
+
+void encode_regions_scalar(const float* values, size_t n, const double* B, int Nr, uint8_t* out, size_t out_stride) {
+    float inner[MAX_REGIONS];
+    const int count = inner_breakpoints(B, Nr, inner);
+    for (size_t idx = 0; idx < n; ++idx) {
+        out[idx * out_stride] = region_of(values[idx], inner, count);
+    }
+}
+
+void encode_regions(const float* values, size_t n, const double* B, int Nr, uint8_t* out, size_t out_stride) {
+    float inner[MAX_REGIONS];
+    const int count = inner_breakpoints(B, Nr, inner);
+    size_t idx = 0;
+
+#if defined(__AVX512F__)
+    alignas(64) int32_t lanes[16];
+    for (; idx + 16 <= n; idx += 16) {
+        __m512 v = _mm512_loadu_ps(values + idx);
+        __m512i acc = _mm512_setzero_si512();
+        const __m512i one = _mm512_set1_epi32(1);
+        for (int r = 0; r < count; ++r) {
+            __mmask16 le = _mm512_cmp_ps_mask(_mm512_set1_ps(inner[r]), v, _CMP_LE_OQ);
+            acc = _mm512_mask_add_epi32(acc, le, acc, one);
+        }
+        if (out_stride == 1) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx), _mm512_cvtepi32_epi8(acc));
+        } else {
+            _mm512_store_si512(lanes, acc);
+            for (int t = 0; t < 16; ++t) {
+                out[(idx + t) * out_stride] = static_cast<uint8_t>(lanes[t]);
+            }
+        }
+    }
+#elif defined(__AVX2__)
+    alignas(32) int32_t lanes[8];
+    for (; idx + 8 <= n; idx += 8) {
+        __m256 v = _mm256_loadu_ps(values + idx);
+        __m256i acc = _mm256_setzero_si256();
+        for (int r = 0; r < count; ++r) {
+            // La máscara vale -1 donde B[r] <= v: restarla suma 1
+            __m256 le = _mm256_cmp_ps(_mm256_set1_ps(inner[r]), v, _CMP_LE_OQ);
+            acc = _mm256_sub_epi32(acc, _mm256_castps_si256(le));
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        for (int t = 0; t < 8; ++t) {
+            out[(idx + t) * out_stride] = static_cast<uint8_t>(lanes[t]);
+        }
+    }
+#endif
+
+    for (; idx < n; ++idx) {
+        out[idx * out_stride] = region_of(values[idx], inner, count);
+    }
+}
+
+const char* encode_kernel_name() {
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
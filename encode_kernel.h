@@ -0,0 +1,28 @@
+#ifndef ENCODE_KERNEL_H
+#define ENCODE_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Máximo de regiones por dimensión: los códigos se guardan en un byte
+const int MAX_REGIONS = 256;
+
+// Región de cada valor = cantidad de breakpoints internos B[1..Nr-1] <= valor.
+// Es equivalente a buscar r con B[r] <= v < B[r + 1] (los valores fuera de
+// [B[0], B[Nr]) quedan en la primera o la última región), pero sin saltos:
+// se compara contra todos los breakpoints y se suman las máscaras, 16 puntos
+// por instrucción con AVX-512, 8 con AVX2 o uno a uno sin SIMD.
+//
+//   values: n valores contiguos (una columna [L][K][n]), enteros por el floor
+//   B:      Nr + 1 breakpoints ordenados, también enteros (salen de valores
+//           proyectados); ver la nota sobre float en encode_kernel.cpp
+//   out:    out[idx * out_stride] recibe el código del valor idx
+void encode_regions(const float* values, size_t n, const double* B, int Nr, uint8_t* out, size_t out_stride);
+
+// Variante escalar, siempre disponible (referencia para las pruebas)
+void encode_regions_scalar(const float* values, size_t n, const double* B, int Nr, uint8_t* out, size_t out_stride);
+
+// "avx512", "avx2" o "scalar", según con qué se compiló
+const char* encode_kernel_name();
+
+#endif // ENCODE_KERNEL_H
@@ -5,6 +5,10 @@
 #include <random>
 #include <numeric>
 #include <chrono>
+#include "encoding.h"
+#include "quantile_sketch.h"
+#include "encode_kernel.h"
+#include <stdexcept>
 
 using namespace std;
 using namespace std::chrono;
@@ -17,7 +21,7 @@ void divide_and_conquer_breakpoints(vector<double>& C_ij, vector<double>& B_ij,
     }
 }
 
-vector<vector<vector<double>>> breakpoints_selection_non_optimized(int K, int L, int n, const vector<vector<vector<double>>>& P, int n_s, int N_r) {
+vector<vector<vector<double>>> breakpoints_selection_non_optimized(int K, int L, int n, const ProjectionBuffer& P, int n_s, int N_r) {
     
     auto start = high_resolution_clock::now();
     
@@ -27,7 +31,7 @@ vector<vector<vector<double>>> breakpoints_selection_non_optimized(int K, int L,
             // Muestra aleatoria de n_s puntos
             vector<double> C_ij(n_s);
             for (int s = 0; s < n_s; ++s) {
-                C_ij[s] = P[i][j][s];
+                C_ij[s] = P.column(i, j)[s];
             }
             int rounds = log2(N_r);
             for (int z = 1; z <= rounds; ++z) {
@@ -49,18 +53,21 @@ vector<vector<vector<double>>> breakpoints_selection_non_optimized(int K, int L,
 }
 
 
-vector<vector<vector<double>>> breakpoints_selection(int K, int L, int n, const vector<vector<vector<double>>>& P, int n_s, int N_r) {
+vector<vector<vector<double>>> breakpoints_selection(int K, int L, int n, const ProjectionBuffer& P, int n_s, int N_r, ThreadPool& pool) {
 
     auto start = high_resolution_clock::now();
 
     vector<vector<vector<double>>> B(L, vector<vector<double>>(K, vector<double>(N_r + 1)));
 
-    for (int i = 0; i < L; ++i) { 
-        for (int j = 0; j < K; ++j) { 
+    // Cada columna (i, j) es independiente: una tarea por columna
+    ParallelStats stats = pool.parallel_for(L * K, 1, [&](size_t begin, size_t end) {
+        for (size_t column = begin; column < end; ++column) {
+            int i = column / K;
+            int j = column % K;
 
             vector<double> C_ij(n_s);
             for (int s = 0; s < n_s; ++s) {
-                C_ij[s] = P[i][j][s];
+                C_ij[s] = P.column(i, j)[s];
             }
 
             // Ordenamos completamente la muestra
@@ -76,64 +83,145 @@ vector<vector<vector<double>>> breakpoints_selection(int K, int L, int n, const
             B[i][j][0] = C_ij.front();
             B[i][j][N_r] = C_ij.back();
         }
-    }
+    });
 
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(stop - start);
 
-    cout << "Breakpoints selection: " << duration.count() << " microseconds" << endl;
+    cout << "Breakpoints selection: " << duration.count() << " microseconds ("
+         << stats.threads << " threads, utilization " << stats.utilization() << "x)" << endl;
 
     return B;
 }
 
 
-int binary_search_region(int value, const vector<int>& breakpoints) {
-    auto it = upper_bound(breakpoints.begin(), breakpoints.end(), value);
-    return distance(breakpoints.begin(), it) - 1;  // Índice de la región
+// Breakpoints de una columna: los cuantiles qs del sketch entre el mínimo
+// y el máximo exactos
+static void column_breakpoints(const KLLSketch& sketch, const vector<double>& qs, int N_r, vector<double>& B_ij) {
+    vector<float> cuts = sketch.quantiles(qs);
+    for (int z = 1; z < N_r; ++z) {
+        B_ij[z] = cuts[z - 1];
+    }
+    B_ij[0] = sketch.min();
+    B_ij[N_r] = sketch.max();
 }
 
+// Cuantiles z / N_r para z = 1 .. N_r - 1
+static vector<double> region_quantiles(int N_r) {
+    vector<double> qs;
+    for (int z = 1; z < N_r; ++z) {
+        qs.push_back(static_cast<double>(z) / N_r);
+    }
+    return qs;
+}
 
-vector<vector<vector<int>>> dynamic_encoding(int K, int L, int n, const vector<vector<vector<double>>>& P, int ns, int Nr) {
 
-    vector<vector<vector<int>>> EP(L, vector<vector<int>>(P[0].size(), vector<int>(K, 0))); // 𝑛 · 𝐿 · 𝐾
+vector<vector<vector<double>>> breakpoints_from_sketches(int K, int L, const vector<KLLSketch>& sketches, int N_r) {
+    const vector<double> qs = region_quantiles(N_r);
+    vector<vector<vector<double>>> B(L, vector<vector<double>>(K, vector<double>(N_r + 1)));
+    for (int i = 0; i < L; ++i) {
+        for (int j = 0; j < K; ++j) {
+            column_breakpoints(sketches[i * K + j], qs, N_r, B[i][j]);
+        }
+    }
+    return B;
+}
 
-    auto B = breakpoints_selection(K, L, n, P, ns, Nr);
 
+vector<vector<vector<double>>> breakpoints_selection_sketch(int K, int L, int n, const ProjectionBuffer& P, int N_r, int sketch_k, ThreadPool& pool) {
 
     auto start = high_resolution_clock::now();
 
-    // Iterar sobre los espacios proyectados, dimensiones y puntos
-    for (int i = 0; i < L; ++i) {
-        for (int j = 0; j < K; ++j) {
-
-
-            for (int idx = 0; idx < n; ++idx) {
+    // Bloques de puntos fijos (no dependen del número de hilos)
+    const size_t block = 65536;
+    const size_t blocks = (static_cast<size_t>(n) + block - 1) / block;
+    const vector<double> qs = region_quantiles(N_r);
+    vector<vector<vector<double>>> B(L, vector<vector<double>>(K, vector<double>(N_r + 1)));
 
-                // Encontrar el rango del punto según los breakpoints
-                for (int r = 0; r < Nr; ++r) {
-                    if (B[i][j][r] <= EP[i][idx][j] &&
-                        EP[i][idx][j] < B[i][j][r + 1]) {
-                        EP[i][idx][j] = r;
-                        break;
-                    }
+    // Una tarea por columna: cada bloque se resume en un sketch con la
+    // semilla del bloque y se combina enseguida con el acumulado, en orden.
+    // Solo viven un sketch acumulado y uno parcial por columna en curso, y el
+    // resultado es el mismo con cualquier cantidad de hilos
+    ParallelStats stats = pool.parallel_for(size_t(L) * K, 1, [&](size_t begin, size_t end) {
+        for (size_t column = begin; column < end; ++column) {
+            const float* values = P.column(column / K, column % K);
+            KLLSketch merged(sketch_k);
+            for (size_t b = 0; b < blocks; ++b) {
+                KLLSketch part(sketch_k, b + 1);
+                const size_t last = min(static_cast<size_t>(n), (b + 1) * block);
+                for (size_t idx = b * block; idx < last; ++idx) {
+                    part.update(values[idx]);
                 }
+                merged.merge(part);
             }
+            column_breakpoints(merged, qs, N_r, B[column / K][column % K]);
         }
-    }
+    });
+
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(stop - start);
+
+    cout << "Breakpoints selection (sketch): " << duration.count() << " microseconds ("
+         << stats.threads << " threads, utilization " << stats.utilization() << "x)" << endl;
+
+    return B;
+}
+
+
+int binary_search_region(int value, const vector<int>& breakpoints) {
+    auto it = upper_bound(breakpoints.begin(), breakpoints.end(), value);
+    return distance(breakpoints.begin(), it) - 1;  // Índice de la región
+}
+
+
+CodeBuffer dynamic_encoding(int K, int L, int n, const ProjectionBuffer& P, int ns, int Nr, ThreadPool& pool) {
+
+    auto B = breakpoints_selection(K, L, n, P, ns, Nr, pool);
+
+
+    auto start = high_resolution_clock::now();
+
+    CodeBuffer EP = encode_with_breakpoints(K, L, n, P, B, Nr, pool);
 
     auto stop = high_resolution_clock::now();
 
     auto duration = duration_cast<microseconds>(stop - start);
 
-    cout << "Dynamic encoding: " << duration.count() << " microseconds" << endl;
+    cout << "Dynamic encoding: " << duration.count() << " microseconds ("
+         << encode_kernel_name() << ", " << pool.size() << " threads)" << endl;
 
     return EP;
 
 }
 
-vector<vector<vector<int>>> dynamic_encoding_non_optimized(int K, int L, int n, const vector<vector<vector<double>>>& P, int ns, int Nr) {
+CodeBuffer encode_with_breakpoints(int K, int L, int n, const ProjectionBuffer& P, const vector<vector<vector<double>>>& B, int Nr, ThreadPool& pool) {
+
+    if (Nr < 1 || Nr > MAX_REGIONS) {
+        throw invalid_argument("Nr must be between 1 and 256 to fit 8-bit codes");
+    }
+
+    CodeBuffer EP(L, n, K); // 𝐿 · 𝑛 · 𝐾
+
+    // Bloques pequeños de puntos: la columna leída y las filas escritas
+    // quedan en caché mientras se recorren las K dimensiones
+    const size_t block = 1024;
+    pool.parallel_for(n, 16 * block, [&](size_t begin, size_t end) {
+        for (size_t b0 = begin; b0 < end; b0 += block) {
+            size_t b1 = min(end, b0 + block);
+            for (int i = 0; i < L; ++i) {
+                for (int j = 0; j < K; ++j) {
+                    encode_regions(P.column(i, j) + b0, b1 - b0, B[i][j].data(), Nr, EP.row(i, b0) + j, K);
+                }
+            }
+        }
+    });
+
+    return EP;
+}
+
+CodeBuffer dynamic_encoding_non_optimized(int K, int L, int n, const ProjectionBuffer& P, int ns, int Nr) {
 
-    vector<vector<vector<int>>> EP(L, vector<vector<int>>(P[0].size(), vector<int>(K, 0))); // 𝑛 · 𝐿 · 𝐾
+    CodeBuffer EP(L, P.size(), K); // 𝐿 · 𝑛 · 𝐾
 
     auto B = breakpoints_selection_non_optimized(K, L, n, P, ns, Nr);
 
@@ -146,12 +234,13 @@ vector<vector<vector<int>>> dynamic_encoding_non_optimized(int K, int L, int n,
 
 
             for (int idx = 0; idx < n; ++idx) {
+                double value = P.at(i, idx, j);
 
                 // Encontrar el rango del punto según los breakpoints
                 for (int r = 0; r < Nr; ++r) {
-                    if (B[i][j][r] <= EP[i][idx][j] &&
-                        EP[i][idx][j] < B[i][j][r + 1]) {
-                        EP[i][idx][j] = r;
+                    if (B[i][j][r] <= value &&
+                        value < B[i][j][r + 1]) {
+                        EP.at(i, idx, j) = r;
                         break;
                     }
                 }
@@ -2,15 +2,33 @@
 #define BREAKPOINTS_H
 
 #include <vector>
+#include "thread_pool.h"
+#include "buffers.h"
+#include "quantile_sketch.h"
 
 using namespace std;
 
-vector<vector<vector<double>>> breakpoints_selection(int K, int L, int n, const vector<vector<vector<double>>>& P, int n_s, int N_r);
+vector<vector<vector<double>>> breakpoints_selection(int K, int L, int n, const ProjectionBuffer& P, int n_s, int N_r, ThreadPool& pool = ThreadPool::shared());
 
-vector<vector<vector<double>>> breakpoints_selection_non_optimized(int K, int L, int n, const vector<vector<vector<double>>>& P, int n_s, int N_r);
+// Breakpoints de igual frecuencia sobre los n valores de cada columna (i, j),
+// en una sola pasada con sketches KLL. Cada tarea recorre una columna por
+// bloques de 65536 puntos y combina el sketch de cada bloque con el
+// acumulado apenas lo termina, en orden fijo (resultado determinista y
+// memoria de un sketch acumulado por columna).
+vector<vector<vector<double>>> breakpoints_selection_sketch(int K, int L, int n, const ProjectionBuffer& P, int N_r, int sketch_k = 200, ThreadPool& pool = ThreadPool::shared());
 
-vector<vector<vector<int>>> dynamic_encoding(int K, int L, int n, const vector<vector<vector<double>>>& P, int ns, int Nr);
+// Breakpoints de igual frecuencia a partir de un sketch por columna ya
+// combinado, sketches[i·K + j]; los extremos son el mínimo y el máximo exactos
+vector<vector<vector<double>>> breakpoints_from_sketches(int K, int L, const vector<KLLSketch>& sketches, int N_r);
 
-vector<vector<vector<int>>> dynamic_encoding_non_optimized(int K, int L, int n, const vector<vector<vector<double>>>& P, int ns, int Nr);
+vector<vector<vector<double>>> breakpoints_selection_non_optimized(int K, int L, int n, const ProjectionBuffer& P, int n_s, int N_r);
+
+CodeBuffer dynamic_encoding(int K, int L, int n, const ProjectionBuffer& P, int ns, int Nr, ThreadPool& pool = ThreadPool::shared());
+
+CodeBuffer dynamic_encoding_non_optimized(int K, int L, int n, const ProjectionBuffer& P, int ns, int Nr);
+
+// Codifica puntos proyectados [L][K][n] con breakpoints ya calculados; devuelve [L][n][K].
+// Útil cuando el dataset se procesa por bloques y B se fija de antemano.
+CodeBuffer encode_with_breakpoints(int K, int L, int n, const ProjectionBuffer& P, const vector<vector<vector<double>>>& B, int Nr, ThreadPool& pool = ThreadPool::shared());
 
 #endif // BREAKPOINTS_H
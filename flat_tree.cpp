@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include "flat_tree.h"
+#include "indexing.h"
+
+using namespace std;
+
+FlatDETree::FlatDETree(const DETree& tree, const PackedCodes& packed, size_t space, const vector<vector<double>>& Bi)
+    : K(tree.K), bits_per_code(code_bits(tree.Nr)), lane_bits(packed.bits()), words(packed.words_per_row()),
+      region_bounds(Bi) {
+    const TreeNode* root = tree.root;
+    if (root->child_count != root_children()) {
+        throw invalid_argument("DE-Tree root must have 2^K children");
+    }
+
+    // Cola BFS de pares (nodo de punteros, índice plano ya reservado)
+    vector<pair<const TreeNode*, uint32_t>> queue;
+    nodes.resize(root_children());
+    boxes.resize(nodes.size() * 2 * K);
+    for (size_t c = 0; c < root_children(); ++c) {
+        queue.push_back({root->children[c], static_cast<uint32_t>(c)});
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const TreeNode* source = queue[head].first;
+        const uint32_t idx = queue[head].second;
+        copy(source->box, source->box + 2 * K, boxes.begin() + size_t(idx) * 2 * K);
+
+        if (source->is_leaf()) {
+            FlatNode leaf{static_cast<uint32_t>(ids.size()), source->count, 0, 0};
+            ids.insert(ids.end(), source->ids, source->ids + source->count);
+            for (uint32_t t = 0; t < source->count; ++t) {
+                const uint64_t* row = packed.row(space, source->ids[t]);
+                codes.insert(codes.end(), row, row + words);
+            }
+            nodes[idx] = leaf;
+            continue;
+        }
+
+        const uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.resize(nodes.size() + 2);
+        boxes.resize(nodes.size() * 2 * K);
+        nodes[idx] = FlatNode{left, FlatNode::INTERNAL,
+                              static_cast<uint16_t>(source->split_dimension),
+                              static_cast<uint16_t>(source->split_bit)};
+        queue.push_back({source->left, left});
+        queue.push_back({source->right, left + 1});
+    }
+
+    n_nodes = nodes.size();
+    n_ids = ids.size();
+    node_data = nodes.data();
+    id_data = ids.data();
+    code_data = codes.data();
+    box_data = boxes.data();
+}
+
+FlatDETree FlatDETree::view(int K, int Nr, int lane_bits, size_t words,
+                            const FlatNode* nodes, size_t node_count, const uint32_t* ids, size_t size,
+                            const uint64_t* codes, const uint8_t* boxes, const double* edges) {
+    FlatDETree tree;
+    tree.K = K;
+    tree.bits_per_code = code_bits(Nr);
+    tree.lane_bits = lane_bits;
+    tree.words = words;
+    tree.n_nodes = node_count;
+    tree.n_ids = size;
+    tree.node_data = nodes;
+    tree.id_data = ids;
+    tree.code_data = codes;
+    tree.box_data = boxes;
+    tree.region_bounds = RegionBounds(K, Nr, edges);
+    return tree;
+}
+
+uint32_t FlatDETree::find_leaf(const uint8_t* epi) const {
+    uint32_t idx = static_cast<uint32_t>(root_child(epi, K, bits_per_code));
+    while (!node_data[idx].is_leaf()) {
+        const FlatNode& n = node_data[idx];
+        idx = n.first + ((epi[n.split_dimension] >> n.split_bit) & 1);
+    }
+    return idx;
+}
+
+vector<FlatDETree> flatten_index(const vector<DETree>& DETs, const PackedCodes& codes, const vector<vector<vector<double>>>& B) {
+    vector<FlatDETree> flat;
+    flat.reserve(DETs.size());
+    for (size_t i = 0; i < DETs.size(); ++i) {
+        flat.emplace_back(DETs[i], codes, i, B[i]);
+    }
+    return flat;
+}
+
+namespace {
+
+// Recorrido de una consulta de rango desde los nodos de `stack` hasta
+// vaciarla. Lo que queda fuera de r2 (nodos, y puntos de hojas abiertas)
+// se entrega a pruned(lower2, ref, es_punto). Con Exact = false los puntos
+// solo se comparan contra r2 (con corte temprano) y su cota no se calcula.
+template <bool Exact, typename Pruned>
+size_t traverse(const FlatDETree& tree, const QueryBounds& bounds, double r2, vector<pair<uint32_t, bool>>& stack,
+                vector<uint32_t>& S, const atomic<bool>* stop, size_t max_leaves, Pruned pruned) {
+    const int K = tree.dims();
+    size_t leaves = 0;
+
+    while (!stack.empty()) {
+        if ((stop && stop->load(memory_order_relaxed)) || leaves >= max_leaves) {
+            return leaves;
+        }
+        const uint32_t idx = stack.back().first;
+        bool inside = stack.back().second;
+        stack.pop_back();
+
+        if (!inside) {
+            const uint8_t* box = tree.box(idx);
+            const double lower2 = bounds.lower2(box, box + K);
+            if (lower2 > r2) {
+                pruned(lower2, idx, false);
+                continue;
+            }
+            inside = bounds.upper2(box, box + K) <= r2;
+        }
+
+        const FlatNode& node = tree.node(idx);
+        if (!node.is_leaf()) {
+            stack.push_back({node.first + 1, inside});
+            stack.push_back({node.first, inside});
+            continue;
+        }
+
+        leaves++;
+        const uint32_t* ids = tree.leaf_ids(node);
+        if (inside) {
+            S.insert(S.end(), ids, ids + node.count);
+            continue;
+        }
+
+        // La región de cada punto es una caja de una sola región por
+        // dimensión: K búsquedas sobre los códigos empaquetados
+        const uint64_t* codes = tree.leaf_codes(node);
+        const size_t words = tree.words_per_row();
+        const int bits = tree.bits();
+        for (uint32_t t = 0; t < node.count; ++t) {
+            if (Exact) {
+                const double lower2 = bounds.point_lower2(codes + t * words, bits);
+                if (lower2 <= r2) {
+                    S.push_back(ids[t]);
+                } else {
+                    pruned(lower2, ids[t], true);
+                }
+            } else if (bounds.point_within(codes + t * words, bits, r2)) {
+                S.push_back(ids[t]);
+            }
+        }
+    }
+
+    return leaves;
+}
+
+} // namespace
+
+size_t flat_range_query(const FlatDETree& tree, const double* q_prime, double r_prime, vector<uint32_t>& S,
+                        const atomic<bool>* stop) {
+    const double r2 = r_prime * r_prime;
+    // Tablas de la consulta para este árbol: las cotas pasan a ser búsquedas
+    const QueryBounds bounds(tree.bounds(), q_prime);
+    size_t leaves = 0;
+
+    // Pila de (nodo, subárbol entero dentro del radio)
+    vector<pair<uint32_t, bool>> stack;
+    auto ignore = [](double, uint32_t, bool) {};
+
+    for (size_t c = 0; c < tree.root_children(); ++c) {
+        if (stop && stop->load(memory_order_relaxed)) {
+            break;
+        }
+        stack.push_back({static_cast<uint32_t>(c), false});
+        leaves += traverse<false>(tree, bounds, r2, stack, S, stop, SIZE_MAX, ignore);
+    }
+
+    return leaves;
+}
+
+void RangeCursor::reset(const FlatDETree& tree, const double* q_prime) {
+    this->tree = &tree;
+    bounds.reset(tree.bounds(), q_prime);
+    frontier.clear();
+    stack.clear();
+    // Los hijos de la raíz entran con cota 0: el primer expand los abre a todos
+    for (size_t c = 0; c < tree.root_children(); ++c) {
+        frontier.push_back({0.0, static_cast<uint32_t>(c), false});
+    }
+}
+
+void RangeCursor::prune(double lower2, uint32_t ref, bool point) {
+    frontier.push_back({lower2, ref, point});
+    push_heap(frontier.begin(), frontier.end(), greater<Pending>());
+}
+
+double RangeCursor::next_lower2() const {
+    return frontier.empty() ? numeric_limits<double>::infinity() : frontier.front().lower2;
+}
+
+size_t RangeCursor::expand(double r_prime, vector<uint32_t>& S, const atomic<bool>* stop, size_t max_leaves) {
+    const double r2 = r_prime * r_prime;
+
+    // Lo podado cuya cota ya entra: los puntos van directo a S y los nodos
+    // se recorren como en flat_range_query
+    while (!frontier.empty() && frontier.front().lower2 <= r2) {
+        pop_heap(frontier.begin(), frontier.end(), greater<Pending>());
+        const Pending entry = frontier.back();
+        frontier.pop_back();
+        if (entry.point) {
+            S.push_back(entry.ref);
+        } else {
+            stack.push_back({entry.ref, false});
+        }
+    }
+
+    const size_t leaves = traverse<true>(*tree, bounds, r2, stack, S, stop, max_leaves,
+        [this](double lower2, uint32_t ref, bool point) { prune(lower2, ref, point); });
+
+    // Si la expansión se cortó (stop o max_leaves), lo pendiente vuelve a
+    // la frontera con cota 0 y la siguiente llamada lo retoma
+    for (const auto& entry : stack) {
+        prune(0.0, entry.first, false);
+    }
+    stack.clear();
+    return leaves;
+}
@@ -0,0 +1,158 @@
+#ifndef FLAT_TREE_H
+#define FLAT_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "tree_node.h"
+#include "packed_codes.h"
+#include "region_bounds.h"
+
+using namespace std;
+
+// Nodo de 12 bytes de un DE-Tree plano, direccionado por índices de 32 bits
+struct FlatNode {
+    static constexpr uint32_t INTERNAL = 0xFFFFFFFFu;
+
+    uint32_t first;            // Interno: hijo izquierdo (el derecho es first + 1). Hoja: inicio en ids
+    uint32_t count;            // Hoja: cantidad de puntos. Interno: INTERNAL
+    uint16_t split_dimension;  // Dimensión cuyo bit separa left (0) de right (1)
+    uint16_t split_bit;
+
+    bool is_leaf() const { return count != INTERNAL; }
+};
+
+// DE-Tree en arreglos contiguos, sin punteros. Los 2^K hijos de la raíz
+// ocupan los nodos [0, 2^K) y el resto sigue en orden BFS, con los dos
+// hijos de cada nodo interno uno al lado del otro. Las hojas apuntan a
+// rangos de un único arreglo de ids y de otro con los códigos empaquetados
+// de cada id, copiados en el mismo orden para recorrer las hojas sin saltos.
+// Cada nodo guarda además la caja de regiones de su subárbol, que junto con
+// los breakpoints del espacio da cotas de distancia para podar.
+// Los arreglos pueden ser propios o una vista sobre memoria externa (un
+// índice mapeado, ver index_file.h); el árbol se puede mover, no copiar.
+class FlatDETree {
+public:
+    FlatDETree() = default;
+    FlatDETree(const FlatDETree&) = delete;
+    FlatDETree& operator=(const FlatDETree&) = delete;
+    FlatDETree(FlatDETree&&) = default;
+    FlatDETree& operator=(FlatDETree&&) = default;
+
+    // Copia un DE-Tree de punteros (create_index, bulk_load_index); los
+    // códigos de sus puntos salen del espacio `space` de `codes` y Bi son
+    // los breakpoints de ese espacio
+    FlatDETree(const DETree& tree, const PackedCodes& codes, size_t space, const vector<vector<double>>& Bi);
+
+    // Árbol sobre arreglos ya armados, sin copiarlos (salvo los breakpoints,
+    // [K][Nr + 1]); deben vivir más que el árbol
+    static FlatDETree view(int K, int Nr, int lane_bits, size_t words,
+                           const FlatNode* nodes, size_t node_count, const uint32_t* ids, size_t size,
+                           const uint64_t* codes, const uint8_t* boxes, const double* edges);
+
+    int dims() const { return K; }
+    size_t root_children() const { return size_t(1) << K; }
+    size_t node_count() const { return n_nodes; }
+    size_t size() const { return n_ids; }
+    int bits() const { return lane_bits; }
+    size_t words_per_row() const { return words; }
+    size_t bytes() const {
+        return n_nodes * sizeof(FlatNode) + n_ids * sizeof(uint32_t) + n_ids * words * sizeof(uint64_t);
+    }
+
+    const FlatNode& node(uint32_t idx) const { return node_data[idx]; }
+    // Caja del nodo: lo en [0, K) y hi en [K, 2K)
+    const uint8_t* box(uint32_t idx) const { return box_data + size_t(idx) * 2 * K; }
+    const RegionBounds& bounds() const { return region_bounds; }
+    const uint32_t* leaf_ids(const FlatNode& leaf) const { return id_data + leaf.first; }
+    // Códigos empaquetados de la hoja: words_per_row() palabras por id
+    const uint64_t* leaf_codes(const FlatNode& leaf) const { return code_data + size_t(leaf.first) * words; }
+
+    // Arreglos completos, para guardar el árbol tal cual (index_file.h)
+    const FlatNode* node_array() const { return node_data; }
+    const uint32_t* id_array() const { return id_data; }
+    const uint64_t* code_array() const { return code_data; }  // [size()][words_per_row()]
+    const uint8_t* box_array() const { return box_data; }     // [node_count()][2K]
+
+    // Hoja donde cae un punto codificado
+    uint32_t find_leaf(const uint8_t* epi) const;
+
+private:
+    int K = 0;
+    int bits_per_code = 0;  // Bits de los códigos de región (code_bits(Nr))
+    int lane_bits = 0;      // Bits por código en el empaquetado
+    size_t words = 0;
+    size_t n_nodes = 0;
+    size_t n_ids = 0;
+    // Arreglos que se leen en las consultas: apuntan a los vectores de
+    // abajo o a memoria externa
+    const FlatNode* node_data = nullptr;
+    const uint32_t* id_data = nullptr;
+    const uint64_t* code_data = nullptr;
+    const uint8_t* box_data = nullptr;
+    // Arreglos propios (vacíos en una vista). Mover un vector no cambia su
+    // buffer, así que los punteros siguen valiendo después de un move
+    vector<FlatNode> nodes;
+    vector<uint32_t> ids;
+    vector<uint64_t> codes;  // [size()][words], en el orden de ids
+    vector<uint8_t> boxes;   // [node_count()][2K]
+    RegionBounds region_bounds;
+};
+
+vector<FlatDETree> flatten_index(const vector<DETree>& DETs, const PackedCodes& codes, const vector<vector<vector<double>>>& B);
+
+// Consulta de rango sobre un árbol plano (q_prime en el espacio proyectado):
+// recorre con una pila explícita, descarta los nodos cuya cota inferior
+// pasa de r_prime y agrega a S los ids cuya región está a distancia
+// <= r_prime. Si la cota superior de un nodo no pasa de r_prime, agrega
+// todo el subárbol sin revisar los puntos. Devuelve las hojas visitadas.
+// Si `stop` se activa (desde otro hilo) el recorrido termina en el
+// siguiente nodo y S queda con lo encontrado hasta ahí.
+size_t flat_range_query(const FlatDETree& tree, const double* q_prime, double r_prime, vector<uint32_t>& S,
+                        const std::atomic<bool>* stop = nullptr);
+
+// Consulta de rango reanudable para radios crecientes. Hace el mismo
+// recorrido que flat_range_query, pero guarda lo que poda (nodos, y puntos
+// de hojas ya abiertas) en una frontera ordenada por cota inferior. Al
+// crecer el radio solo se abren las entradas de la frontera cuya cota
+// ya entra, y cada id se entrega una sola vez: sumando todas las
+// expansiones, el trabajo es cerca de un recorrido con el radio final.
+class RangeCursor {
+public:
+    RangeCursor() = default;
+    RangeCursor(const FlatDETree& tree, const double* q_prime) { reset(tree, q_prime); }
+
+    // Empieza un recorrido nuevo (otra consulta u otro árbol) reusando las
+    // tablas de cotas y la frontera, sin volver a reservar memoria
+    void reset(const FlatDETree& tree, const double* q_prime);
+
+    // Agrega a S los ids que quedan a distancia <= r_prime y que no se
+    // entregaron antes (r_prime no debe bajar entre llamadas). Devuelve las
+    // hojas abiertas. Si `stop` corta la expansión o se abren max_leaves
+    // hojas, la siguiente llamada la retoma.
+    size_t expand(double r_prime, vector<uint32_t>& S, const std::atomic<bool>* stop = nullptr,
+                  size_t max_leaves = SIZE_MAX);
+
+    // Menor cota inferior al cuadrado que queda sin abrir (inf si no queda
+    // nada). Si no pasa de r_prime², expand(r_prime) todavía tiene trabajo
+    double next_lower2() const;
+
+private:
+    struct Pending {
+        double lower2;
+        uint32_t ref;   // Nodo, o id si point
+        bool point;
+
+        bool operator>(const Pending& other) const { return lower2 > other.lower2; }
+    };
+
+    const FlatDETree* tree = nullptr;
+    QueryBounds bounds;
+    vector<Pending> frontier;             // Min-heap por lower2
+    vector<pair<uint32_t, bool>> stack;   // (nodo, subárbol entero dentro del radio)
+
+    void prune(double lower2, uint32_t ref, bool point);
+};
+
+#endif // FLAT_TREE_H
@@ -0,0 +1,340 @@
+#include "index_file.h"
+#include "indexing.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+
+using namespace std;
+
+static_assert(sizeof(FlatNode) == 12, "FlatNode is stored as-is in index files");
+static_assert(sizeof(IndexHeader) % 8 == 0 && sizeof(IndexTreeEntry) % 8 == 0, "Index tables must keep 8-byte alignment");
+
+namespace {
+
+const char INDEX_FILE_MAGIC[4] = {'D', 'E', 'T', 'I'};
+const size_t SECTION_ALIGNMENT = 64;
+
+size_t align_up(size_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// Checksum incremental: las palabras de 64 bits se combinan como en FNV-1a
+// (xor y producto por un primo impar, que es biyectivo, así que cambiar una
+// sola palabra siempre cambia el resultado). Los bytes que no completan una
+// palabra esperan a la siguiente llamada; al final se completan con ceros.
+class Checksum {
+public:
+    void update(const void* data, size_t length) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        while (length > 0 && pending_bytes > 0) {
+            pending[pending_bytes++] = *bytes++;
+            --length;
+            if (pending_bytes == sizeof(uint64_t)) {
+                mix_pending();
+            }
+        }
+        for (; length >= sizeof(uint64_t); bytes += sizeof(uint64_t), length -= sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, bytes, sizeof(uint64_t));
+            mix(word);
+        }
+        while (length-- > 0) {
+            pending[pending_bytes++] = *bytes++;
+        }
+    }
+
+    uint64_t value() {
+        if (pending_bytes > 0) {
+            memset(pending + pending_bytes, 0, sizeof(uint64_t) - pending_bytes);
+            mix_pending();
+        }
+        return hash;
+    }
+
+private:
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    unsigned char pending[sizeof(uint64_t)];
+    size_t pending_bytes = 0;
+
+    void mix(uint64_t word) {
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+
+    void mix_pending() {
+        uint64_t word;
+        memcpy(&word, pending, sizeof(uint64_t));
+        mix(word);
+        pending_bytes = 0;
+    }
+};
+
+// Escribe las secciones en orden, rellenando con ceros hasta cada offset y
+// sumando al checksum todo lo que va después de la cabecera
+class SectionWriter {
+public:
+    SectionWriter(ofstream& out, Checksum& checksum) : out(out), checksum(checksum) {}
+
+    void write_at(size_t offset, const void* data, size_t length) {
+        static const char zeros[SECTION_ALIGNMENT] = {};
+        while (position < offset) {
+            const size_t gap = min(offset - position, SECTION_ALIGNMENT);
+            emit(zeros, gap);
+        }
+        emit(data, length);
+    }
+
+private:
+    ofstream& out;
+    Checksum& checksum;
+    size_t position = sizeof(IndexHeader);
+
+    void emit(const void* data, size_t length) {
+        out.write(static_cast<const char*>(data), length);
+        checksum.update(data, length);
+        position += length;
+    }
+};
+
+uint64_t header_checksum(IndexHeader header) {
+    header.header_checksum = 0;
+    return index_checksum(reinterpret_cast<const unsigned char*>(&header), sizeof(IndexHeader));
+}
+
+// streambuf de solo lectura sobre un rango de memoria, para leer el estado
+// LSH con LSH::load sin copiar la sección
+class MemoryBuffer : public streambuf {
+public:
+    MemoryBuffer(const unsigned char* data, size_t length) {
+        char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+        setg(begin, begin, begin + length);
+    }
+};
+
+// `count` elementos de `element_size` bytes desde `offset`, sin desbordar
+// la multiplicación con un count corrupto
+bool section_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size) {
+    return offset % SECTION_ALIGNMENT == 0 && offset <= file_size &&
+           count <= (file_size - offset) / element_size;
+}
+
+// Recorre todos los datos: toca cada página del archivo
+bool payload_matches(const MappedFile& file) {
+    const IndexHeader& header = *reinterpret_cast<const IndexHeader*>(file.data());
+    return index_checksum(file.data() + sizeof(IndexHeader), file.size() - sizeof(IndexHeader)) == header.payload_checksum;
+}
+
+// Todos los ids de los árboles son posiciones válidas del dataset. Lee
+// todas las secciones de ids
+bool ids_below(const vector<FlatDETree>& DETs, size_t n) {
+    for (const FlatDETree& tree : DETs) {
+        const uint32_t* ids = tree.id_array();
+        if (!all_of(ids, ids + tree.size(), [&](uint32_t id) { return id < n; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Los nodos solo apuntan dentro del árbol: cada hoja a un rango de [0, size)
+// y cada interno a dos hijos posteriores (en BFS los hijos van después del
+// padre, así que el recorrido no puede dar vueltas). Lee solo los nodos
+bool nodes_in_bounds(const FlatNode* nodes, uint64_t node_count, uint64_t size) {
+    for (uint64_t idx = 0; idx < node_count; ++idx) {
+        const FlatNode& node = nodes[idx];
+        if (node.is_leaf() ? uint64_t(node.first) + node.count > size
+                           : node.first <= idx || uint64_t(node.first) + 1 >= node_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const IndexHeader& checked_header(const MappedFile& file, const string& filename, bool verify_checksum) {
+    if (file.size() < sizeof(IndexHeader) || memcmp(file.data(), INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) != 0) {
+        throw runtime_error("Not a DET-LSH index file: " + filename);
+    }
+    // El mapeo empieza en un borde de página: la cabecera queda alineada
+    const IndexHeader& header = *reinterpret_cast<const IndexHeader*>(file.data());
+    if (header.version != INDEX_FILE_VERSION) {
+        throw runtime_error("Unsupported index file version in " + filename);
+    }
+    if (header_checksum(header) != header.header_checksum) {
+        throw runtime_error("Corrupt index header in " + filename);
+    }
+    if (header.file_size != file.size()) {
+        throw runtime_error("Truncated index file: " + filename);
+    }
+    // Los campos de los que salen tamaños, desplazamientos y divisiones se
+    // revisan siempre, haya o no checksum de los datos
+    if (header.K < 1 || header.K > MAX_K || header.L <= 0 || header.Nr < 1 || header.Nr > 256 || header.n == 0 ||
+        header.lane_bits != PackedCodes::bits_for_regions(header.Nr) ||
+        header.words != (size_t(header.K) + 64 / header.lane_bits - 1) / (64 / header.lane_bits) ||
+        size_t(header.L) > (file.size() - sizeof(IndexHeader)) / sizeof(IndexTreeEntry) ||
+        !section_fits(header.lsh_offset, header.lsh_size, 1, header.file_size)) {
+        throw runtime_error("Corrupt index header in " + filename);
+    }
+    if (verify_checksum && !payload_matches(file)) {
+        throw runtime_error("Index checksum mismatch in " + filename);
+    }
+    return header;
+}
+
+LSH load_hash(const MappedFile& file, const string& filename, bool verify_checksum) {
+    const IndexHeader& header = checked_header(file, filename, verify_checksum);
+    MemoryBuffer buffer(file.data() + header.lsh_offset, header.lsh_size);
+    istream in(&buffer);
+    return LSH::load(in, filename);
+}
+
+} // namespace
+
+uint64_t index_checksum(const unsigned char* data, size_t length) {
+    Checksum checksum;
+    checksum.update(data, length);
+    return checksum.value();
+}
+
+void save_index(const string& filename, const LSH& lsh, const vector<FlatDETree>& DETs) {
+    if (DETs.empty() || static_cast<int>(DETs.size()) != lsh.get_L()) {
+        throw invalid_argument("save_index needs one DE-Tree per LSH space");
+    }
+    const FlatDETree& first = DETs[0];
+    for (const FlatDETree& tree : DETs) {
+        if (tree.dims() != first.dims() || tree.bounds().regions() != first.bounds().regions() ||
+            tree.bits() != first.bits() || tree.words_per_row() != first.words_per_row()) {
+            throw invalid_argument("All DE-Trees of an index must share K, Nr and code packing");
+        }
+        if (tree.size() != first.size() || tree.size() == 0 || tree.size() > UINT32_MAX) {
+            throw invalid_argument("All DE-Trees of an index must hold the same n > 0 points");
+        }
+    }
+
+    ostringstream lsh_state;
+    lsh.save(lsh_state);
+    const string state = lsh_state.str();
+
+    IndexHeader header{};
+    memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+    header.version = INDEX_FILE_VERSION;
+    header.K = first.dims();
+    header.L = static_cast<int32_t>(DETs.size());
+    header.Nr = first.bounds().regions();
+    header.lane_bits = first.bits();
+    header.words = static_cast<uint32_t>(first.words_per_row());
+    header.n = static_cast<uint32_t>(first.size());
+
+    // Offsets de todas las secciones antes de escribir nada
+    const size_t K = header.K;
+    const size_t edges_bytes = K * (header.Nr + 1) * sizeof(double);
+    size_t offset = align_up(sizeof(IndexHeader) + DETs.size() * sizeof(IndexTreeEntry));
+    header.lsh_offset = offset;
+    header.lsh_size = state.size();
+    offset = align_up(offset + state.size());
+
+    vector<IndexTreeEntry> table(DETs.size());
+    for (size_t i = 0; i < DETs.size(); ++i) {
+        const FlatDETree& tree = DETs[i];
+        IndexTreeEntry& entry = table[i];
+        entry.node_count = tree.node_count();
+        entry.size = tree.size();
+        entry.edges_offset = offset;
+        offset = align_up(offset + edges_bytes);
+        entry.nodes_offset = offset;
+        offset = align_up(offset + tree.node_count() * sizeof(FlatNode));
+        entry.boxes_offset = offset;
+        offset = align_up(offset + tree.node_count() * 2 * K);
+        entry.ids_offset = offset;
+        offset = align_up(offset + tree.size() * sizeof(uint32_t));
+        entry.codes_offset = offset;
+        offset = align_up(offset + tree.size() * tree.words_per_row() * sizeof(uint64_t));
+    }
+    header.file_size = offset;
+
+    ofstream out(filename, ios::binary);
+    if (!out.is_open()) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+    // La cabecera se reescribe al final, con los checksums
+    out.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+
+    Checksum payload;
+    SectionWriter writer(out, payload);
+    writer.write_at(sizeof(IndexHeader), table.data(), table.size() * sizeof(IndexTreeEntry));
+    writer.write_at(header.lsh_offset, state.data(), state.size());
+    for (size_t i = 0; i < DETs.size(); ++i) {
+        const FlatDETree& tree = DETs[i];
+        const IndexTreeEntry& entry = table[i];
+        writer.write_at(entry.edges_offset, tree.bounds().row(0), edges_bytes);
+        writer.write_at(entry.nodes_offset, tree.node_array(), tree.node_count() * sizeof(FlatNode));
+        writer.write_at(entry.boxes_offset, tree.box_array(), tree.node_count() * 2 * K);
+        writer.write_at(entry.ids_offset, tree.id_array(), tree.size() * sizeof(uint32_t));
+        writer.write_at(entry.codes_offset, tree.code_array(), tree.size() * tree.words_per_row() * sizeof(uint64_t));
+    }
+    writer.write_at(header.file_size, nullptr, 0);
+
+    header.payload_checksum = payload.value();
+    header.header_checksum = header_checksum(header);
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+    if (!out) {
+        throw runtime_error("Error writing index to " + filename);
+    }
+}
+
+MappedIndex::MappedIndex(const string& filename, bool verify_checksum)
+    : file(filename), hash(load_hash(file, filename, verify_checksum)) {
+    const IndexHeader& header = *reinterpret_cast<const IndexHeader*>(file.data());
+    n = header.n;
+    const IndexTreeEntry* table = reinterpret_cast<const IndexTreeEntry*>(file.data() + sizeof(IndexHeader));
+    const unsigned char* base = file.data();
+    const size_t K = header.K;
+
+    if (hash.get_L() != header.L || hash.get_K() != header.K) {
+        throw runtime_error("Corrupt index header in " + filename);
+    }
+
+    // Se revisa que cada sección caiga dentro del archivo, que cada árbol
+    // tenga los n puntos y que sus nodos apunten dentro de él. Los ids no se
+    // leen al abrir: que sean < n lo revisa verify(), junto con el checksum
+    DETs.reserve(header.L);
+    for (int i = 0; i < header.L; ++i) {
+        const IndexTreeEntry& entry = table[i];
+        if (entry.node_count < (size_t(1) << K) || entry.node_count > UINT32_MAX || entry.size != header.n ||
+            !section_fits(entry.edges_offset, K * (header.Nr + 1), sizeof(double), header.file_size) ||
+            !section_fits(entry.nodes_offset, entry.node_count, sizeof(FlatNode), header.file_size) ||
+            !section_fits(entry.boxes_offset, entry.node_count, 2 * K, header.file_size) ||
+            !section_fits(entry.ids_offset, entry.size, sizeof(uint32_t), header.file_size) ||
+            !section_fits(entry.codes_offset, entry.size, header.words * sizeof(uint64_t), header.file_size)) {
+            throw runtime_error("Corrupt index tree table in " + filename);
+        }
+        if (!nodes_in_bounds(reinterpret_cast<const FlatNode*>(base + entry.nodes_offset), entry.node_count, entry.size)) {
+            throw runtime_error("Corrupt index nodes in " + filename);
+        }
+        DETs.push_back(FlatDETree::view(
+            header.K, header.Nr, header.lane_bits, header.words,
+            reinterpret_cast<const FlatNode*>(base + entry.nodes_offset), entry.node_count,
+            reinterpret_cast<const uint32_t*>(base + entry.ids_offset), entry.size,
+            reinterpret_cast<const uint64_t*>(base + entry.codes_offset),
+            base + entry.boxes_offset,
+            reinterpret_cast<const double*>(base + entry.edges_offset)));
+    }
+    // El checksum ya se revisó en checked_header; con él se revisan los ids
+    if (verify_checksum && !ids_below(DETs, n)) {
+        throw runtime_error("Index ids out of range in " + filename);
+    }
+}
+
+bool MappedIndex::verify() const {
+    return payload_matches(file) && ids_below(DETs, n);
+}
+
+void MappedIndex::check_dataset(const DatasetView& dataset) const {
+    if (dataset.size() != n || dataset.dim() != static_cast<size_t>(hash.get_d())) {
+        throw runtime_error("Dataset of " + to_string(dataset.size()) + " x " + to_string(dataset.dim()) +
+                            " does not match the index (" + to_string(n) + " x " + to_string(hash.get_d()) + ")");
+    }
+}
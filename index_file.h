@@ -0,0 +1,95 @@
+#ifndef INDEX_FILE_H
+#define INDEX_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LSH.h"
+#include "dataset.h"
+#include "flat_tree.h"
+#include "vecs_mmap.h"
+
+// Índice completo en un solo archivo binario: las funciones hash (H, w y
+// semilla), y por cada DE-Tree plano sus breakpoints B[i], nodos, cajas, ids y
+// códigos empaquetados, tal como están en memoria. Las secciones quedan
+// alineadas a 64 bytes, así que al cargar los árboles se usan directamente
+// desde el mapeo, sin leer ni reconstruir nada.
+//
+// Formato (versión 2, little-endian, cada sección alineada a 64 bytes):
+//   IndexHeader (con n, el tamaño del dataset), seguida de L IndexTreeEntry
+//   con los offsets de cada árbol
+//   estado LSH, en el formato de LSH::save
+//   por árbol: edges [K][Nr + 1] double, nodes FlatNode, boxes [nodos][2K]
+//   uint8, ids uint32, codes [ids][words] uint64
+// La cabecera lleva un checksum de sí misma y otro de todo lo que sigue.
+
+const uint32_t INDEX_FILE_VERSION = 2;
+
+struct IndexHeader {
+    char magic[4];              // "DETI"
+    uint32_t version;
+    uint64_t file_size;
+    uint64_t header_checksum;   // De la cabecera, con este campo en cero
+    uint64_t payload_checksum;  // De los bytes [sizeof(IndexHeader), file_size)
+    int32_t K, L, Nr, lane_bits;
+    uint32_t words;             // Palabras de 64 bits por fila de códigos
+    uint32_t n;                 // Puntos del dataset: cada árbol tiene los n ids, todos < n
+    uint64_t lsh_offset;
+    uint64_t lsh_size;
+};
+
+struct IndexTreeEntry {
+    uint64_t node_count, size;
+    uint64_t edges_offset, nodes_offset, boxes_offset, ids_offset, codes_offset;
+    uint64_t reserved;
+};
+
+// Hash de 64 bits de `length` bytes (múltiplo de 8), palabra por palabra
+uint64_t index_checksum(const unsigned char* data, size_t length);
+
+// Escribe el índice; los árboles deben venir de las mismas funciones hash
+// y tener cada uno los mismos n puntos
+void save_index(const std::string& filename, const LSH& lsh, const std::vector<FlatDETree>& DETs);
+
+// Índice guardado con save_index, abierto con un solo mmap. Los árboles
+// son vistas sobre el mapeo: quedan listos para consultar apenas se
+// revisan la cabecera y los offsets, y las páginas se leen del disco a
+// medida que las consultas las tocan. Solo se copian las funciones hash.
+// Al abrir se revisan siempre la cabecera (con su checksum), los parámetros
+// K, L, Nr, n y el empaquetado, los conteos y offsets de cada árbol, y que
+// cada nodo apunte dentro de su árbol: las hojas a un rango de ids y los
+// internos a hijos posteriores. Los ids en sí (que sean < n) y el checksum
+// de los datos obligan a leer el archivo completo, así que son opcionales:
+// al abrir con verify_checksum, o después con verify().
+class MappedIndex {
+public:
+    explicit MappedIndex(const std::string& filename, bool verify_checksum = false);
+
+    // Si el checksum de los datos coincide con el de la cabecera y todos los
+    // ids son < n (recorre todo el archivo)
+    bool verify() const;
+
+    // Lanza runtime_error si `dataset` no es el del índice (otro tamaño u otra
+    // dimensión): las consultas miden las distancias leyendo sus filas por id
+    void check_dataset(const DatasetView& dataset) const;
+
+    MappedIndex(const MappedIndex&) = delete;
+    MappedIndex& operator=(const MappedIndex&) = delete;
+
+    const LSH& lsh() const { return hash; }
+    const std::vector<FlatDETree>& trees() const { return DETs; }
+    size_t size() const { return n; }  // Puntos del dataset indexado
+    size_t bytes() const { return file.size(); }
+
+    // Pide al kernel que precargue todo el archivo
+    void advise_willneed() const { file.advise_willneed(); }
+
+private:
+    MappedFile file;
+    LSH hash;
+    std::vector<FlatDETree> DETs;
+    size_t n = 0;
+};
+
+#endif // INDEX_FILE_H
@@ -4,85 +4,303 @@
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
-#include "point.h"
+#include <stdexcept>
+#include <string>
 #include "tree_node.h"
+#include "indexing.h"
 #include "chrono"
 
 using namespace std;
 using namespace std::chrono;
 
-void splitNode(TreeNode* node, int dimension, int bit) {
-    TreeNode* left = new TreeNode();
-    TreeNode* right = new TreeNode();
+int code_bits(int Nr) {
+    int bits = 1;
+    while ((1 << bits) < Nr) {
+        bits++;
+    }
+    return bits;
+}
+
+int root_child(const uint8_t* epi, int K, int bits) {
+    int child = 0;
+    for (int j = 0; j < K; j++) {
+        child = (child << 1) | ((epi[j] >> (bits - 1)) & 1);
+    }
+    return child;
+}
 
-    for (const auto& entry : node->entries) {
-        // Acceder al punto
-        const Point& point = entry.first;
+bool split_at_depth(int depth, int K, int bits, int& dimension, int& bit) {
+    // El bit más alto de cada dimensión ya lo usó la raíz
+    if (depth >= K * (bits - 1)) {
+        return false;
+    }
+    dimension = depth % K;
+    bit = bits - 2 - depth / K;
+    return true;
+}
+
+TreeNode* find_leaf(const DETree& tree, const uint8_t* epi) {
+    TreeNode* node = tree.root->children[root_child(epi, tree.K, code_bits(tree.Nr))];
+    while (!node->is_leaf()) {
+        node = ((epi[node->split_dimension] >> node->split_bit) & 1) ? node->right : node->left;
+    }
+    return node;
+}
+
+void splitNode(DETree& tree, const CodeView& codes, TreeNode* node, int dimension, int bit) {
+    TreeNode* left = tree.new_node();
+    TreeNode* right = tree.new_node();
+    tree.reserve_leaf(left, max(tree.leaf_capacity, node->count));
+    tree.reserve_leaf(right, max(tree.leaf_capacity, node->count));
+
+    uint8_t epi[32];  // K <= MAX_K (init_index)
+    for (uint32_t t = 0; t < node->count; t++) {
+        const uint32_t id = node->ids[t];
+        codes.unpack(id, epi);
 
         // Dividir según el bit de la coordenada en la dimensión especificada
-        if (static_cast<int>(point.coordinates[dimension]) & (1 << bit)) { // Evaluar el bit
-            right->entries.push_back(entry);
-        } else {
-            left->entries.push_back(entry);
-        }
+        TreeNode* child = (epi[dimension] & (1 << bit)) ? right : left; // Evaluar el bit
+        tree.add_entry(child, id);
+        tree.expand_box(child, epi);
     }
 
     node->left = left;
     node->right = right;
-    node->entries.clear();
+    node->split_dimension = dimension;
+    node->split_bit = bit;
+    // El arreglo de la hoja queda en el arena hasta liberar el árbol
+    node->ids = nullptr;
+    node->count = node->capacity = 0;
 }
 
 
-// Algoritmo 3: Crear el índice del árbol
-vector<TreeNode*> create_index(int K, int L, int n, const vector<vector<vector<int>>>& EP, int max_size) {
+// Crea las L raíces vacías (cada una con 2^K hijos iniciales)
+vector<DETree> init_index(int K, int L, int Nr, int max_size) {
+    if (K < 1 || K > MAX_K) {
+        throw invalid_argument("K must be between 1 and " + to_string(MAX_K) + " (the root has 2^K children)");
+    }
+    if (Nr < 1 || Nr > 256) {
+        throw invalid_argument("Nr must be between 1 and 256 to fit 8-bit codes");
+    }
+    vector<DETree> DETs;
+    DETs.reserve(L);
 
-    auto start = high_resolution_clock::now();
+    for (int i = 0; i < L; i++) {
+        DETs.emplace_back(K, Nr, max_size);
+    }
 
-    vector<TreeNode*> DETs(L);
+    return DETs;
+}
 
-    for (int i = 0; i < L; i++) {
-        TreeNode* root = new TreeNode();
+// Inserta un punto codificado en un DE-Tree; permite construir el índice por partes
+void insert_point(DETree& tree, const CodeView& codes, int pos, int max_size) {
+    const int K = tree.K;
+    const int bits = code_bits(tree.Nr);
+    uint8_t epi[32];  // K <= MAX_K (init_index)
+    codes.unpack(pos, epi);
+    TreeNode* target_leaf = tree.root->children[root_child(epi, K, bits)];
+    int depth = 0;
 
-        // Inicializar hijos de la raíz (2^K nodos iniciales)
-        for (int child = 0; child < (1 << K); child++) {
-            TreeNode* childNode = new TreeNode();
-            root->add_child(childNode); // Agregar como hijo
+    // Navegar el árbol hasta encontrar el nodo hoja; las cajas del camino
+    // se agrandan para cubrir el punto
+    tree.expand_box(tree.root, epi);
+    tree.expand_box(target_leaf, epi);
+    while (!target_leaf->is_leaf()) {
+        if ((epi[target_leaf->split_dimension] >> target_leaf->split_bit) & 1) {
+            target_leaf = target_leaf->right;
+        } else {
+            target_leaf = target_leaf->left;
         }
+        tree.expand_box(target_leaf, epi);
+        depth++;
+    }
 
-        for (int z = 0; z < n; z++) {
-            const vector<int>& epi = EP[z][i];
-            int pos = z;
+    // Insertar el punto en el nodo hoja
+    tree.add_entry(target_leaf, static_cast<uint32_t>(pos));
 
-            TreeNode* target_leaf = root;
+    // Dividir la hoja mientras exceda el tamaño máximo y queden bits por usar.
+    // Si todos los puntos caen del mismo lado, el hijo lleno se vuelve a dividir.
+    int dimension, bit;
+    while (target_leaf->count > static_cast<uint32_t>(max_size) &&
+           split_at_depth(depth, K, bits, dimension, bit)) {
+        splitNode(tree, codes, target_leaf, dimension, bit);
+        target_leaf = target_leaf->left->count > target_leaf->right->count
+            ? target_leaf->left : target_leaf->right;
+        depth++;
+    }
+}
 
-            // Navegar el árbol hasta encontrar el nodo hoja
-            while (!target_leaf->is_leaf()) {
-                int dimension = 0; // Lógica para elegir dimensión
-                if (epi[dimension] & (1 << 0)) {
-                    target_leaf = target_leaf->right;
-                } else {
-                    target_leaf = target_leaf->left;
-                }
+
+// Algoritmo 3: Crear el índice del árbol
+vector<DETree> create_index(int K, int L, int n, const CodeBuffer& EP, int Nr, int max_size, ThreadPool& pool) {
+
+    auto start = high_resolution_clock::now();
+
+    vector<DETree> DETs = init_index(K, L, Nr, max_size);
+
+    // Los L árboles son independientes: cada tarea construye uno leyendo
+    // las filas contiguas EP[i][z] de su espacio
+    ParallelStats stats = pool.parallel_for(L, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            CodeView codes(EP, i);
+            for (int z = 0; z < n; z++) {
+                insert_point(DETs[i], codes, z, max_size);
             }
+        }
+    });
+
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(stop - start);
+
+    cout << "Indexing: " << duration.count() << " microseconds ("
+         << stats.threads << " threads, utilization " << stats.utilization() << "x)" << endl;
+
+    return DETs;
+}
 
-            // Insertar el punto en el nodo hoja
-            target_leaf->add_entry(Point(std::vector<double>(epi.begin(), epi.end())), pos);
 
-            // Dividir el nodo si excede el tamaño máximo
-            // Dividirse en dos nodos hijos según una dimensión y un bit relevantes.
-            if (target_leaf->entries.size() >= max_size) {
-                splitNode(target_leaf, 0, 0); // Mejorar lógica de división
-                target_leaf = target_leaf->left;
+namespace {
+
+// Orden en que el árbol consulta los bits de los códigos: primero el bit
+// alto de las K dimensiones (raíz) y luego los de cada nivel
+vector<pair<int, int>> key_schedule(int K, int bits) {
+    vector<pair<int, int>> schedule;
+    for (int j = 0; j < K; j++) {
+        schedule.push_back({j, bits - 1});
+    }
+    int dimension, bit;
+    for (int depth = 0; split_at_depth(depth, K, bits, dimension, bit); depth++) {
+        schedule.push_back({dimension, bit});
+    }
+    return schedule;
+}
+
+// Clave de un punto: sus bits en el orden de `schedule`, del más
+// significativo al menos significativo, en `words` palabras.
+// Ordenar por esta clave deja cada subárbol en un rango contiguo.
+void interleaved_key(const uint8_t* epi, const vector<pair<int, int>>& schedule, uint64_t* key, int words) {
+    size_t p = 0;
+    for (int w = 0; w < words; w++) {
+        uint64_t word = 0;
+        int used = 0;
+        for (; used < 64 && p < schedule.size(); used++, p++) {
+            word = (word << 1) | ((epi[schedule[p].first] >> schedule[p].second) & 1);
+        }
+        key[w] = used == 0 ? 0 : word << (64 - used);
+    }
+}
+
+// Radix sort LSD de los ids por su clave, un byte por pasada. Las pasadas
+// en que todas las claves tienen el mismo byte (p. ej. el relleno de la
+// última palabra) se saltan.
+void radix_sort_ids(vector<int>& ids, const vector<uint64_t>& keys, int words) {
+    const size_t n = ids.size();
+    vector<int> tmp(n);
+    size_t count[256];
+
+    for (int w = words - 1; w >= 0; w--) {
+        for (int shift = 0; shift < 64; shift += 8) {
+            fill(count, count + 256, 0);
+            for (size_t t = 0; t < n; t++) {
+                count[(keys[static_cast<size_t>(ids[t]) * words + w] >> shift) & 0xFF]++;
             }
+            if (*max_element(count, count + 256) == n) {
+                continue;
+            }
+            size_t offset = 0;
+            for (int digit = 0; digit < 256; digit++) {
+                size_t c = count[digit];
+                count[digit] = offset;
+                offset += c;
+            }
+            for (size_t t = 0; t < n; t++) {
+                int id = ids[t];
+                tmp[count[(keys[static_cast<size_t>(id) * words + w] >> shift) & 0xFF]++] = id;
+            }
+            ids.swap(tmp);
         }
+    }
+}
 
-        DETs[i] = root;
+// Arma el subárbol de `node` con los ids ordenados de [lo, hi): si caben en
+// una hoja se copian una sola vez; si no, el rango se corta donde cambia el
+// bit de la división, que dentro del rango ya viene ordenado.
+void build_subtree(DETree& tree, TreeNode* node, const int* ids, size_t lo, size_t hi, int depth,
+                   const CodeBuffer& EP, size_t i, int K, int bits, size_t target) {
+    int dimension, bit;
+    if (hi - lo <= target || !split_at_depth(depth, K, bits, dimension, bit)) {
+        // Hoja del tamaño justo: se llena una sola vez
+        tree.reserve_leaf(node, static_cast<uint32_t>(hi - lo));
+        for (size_t t = lo; t < hi; t++) {
+            tree.add_entry(node, static_cast<uint32_t>(ids[t]));
+            tree.expand_box(node, EP.row(i, ids[t]));
+        }
+        return;
     }
 
+    const int* mid = partition_point(ids + lo, ids + hi, [&](int id) {
+        return ((EP.row(i, id)[dimension] >> bit) & 1) == 0;
+    });
+    node->split_dimension = dimension;
+    node->split_bit = bit;
+    node->left = tree.new_node();
+    node->right = tree.new_node();
+    build_subtree(tree, node->left, ids, lo, mid - ids, depth + 1, EP, i, K, bits, target);
+    build_subtree(tree, node->right, ids, mid - ids, hi, depth + 1, EP, i, K, bits, target);
+    tree.merge_box(node, node->left);
+    tree.merge_box(node, node->right);
+}
+
+} // namespace
+
+vector<DETree> bulk_load_index(int K, int L, int n, const CodeBuffer& EP, int Nr, int max_size, double fill, ThreadPool& pool) {
+
+    auto start = high_resolution_clock::now();
+
+    vector<DETree> DETs = init_index(K, L, Nr, max_size);
+    const int bits = code_bits(Nr);
+    const int words = (K * bits + 63) / 64;
+    const size_t target = max<size_t>(1, static_cast<size_t>(fill * max_size));
+    const vector<pair<int, int>> schedule = key_schedule(K, bits);
+
+    ParallelStats stats = pool.parallel_for(L, 1, [&](size_t begin, size_t end) {
+        vector<uint64_t> keys(static_cast<size_t>(n) * words);
+        vector<int> ids(n);
+        for (size_t i = begin; i < end; i++) {
+            for (int z = 0; z < n; z++) {
+                interleaved_key(EP.row(i, z), schedule, &keys[static_cast<size_t>(z) * words], words);
+                ids[z] = z;
+            }
+            radix_sort_ids(ids, keys, words);
+
+            // Los K bits altos de la clave eligen el hijo de la raíz
+            size_t lo = 0;
+            while (lo < static_cast<size_t>(n)) {
+                int child = root_child(EP.row(i, ids[lo]), K, bits);
+                size_t hi = lo + 1;
+                while (hi < static_cast<size_t>(n) && root_child(EP.row(i, ids[hi]), K, bits) == child) {
+                    hi++;
+                }
+                build_subtree(DETs[i], DETs[i].root->children[child], ids.data(), lo, hi, 0, EP, i, K, bits, target);
+                DETs[i].merge_box(DETs[i].root, DETs[i].root->children[child]);
+                lo = hi;
+            }
+        }
+    });
+
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(stop - start);
 
-    cout << "Indexing: " << duration.count() << " microseconds" << endl;
+    cout << "Bulk loading: " << duration.count() << " microseconds ("
+         << stats.threads << " threads, utilization " << stats.utilization() << "x)" << endl;
 
     return DETs;
 }
+
+size_t index_bytes(const vector<DETree>& DETs) {
+    size_t bytes = 0;
+    for (const DETree& tree : DETs) {
+        bytes += tree.bytes();
+    }
+    return bytes;
+}
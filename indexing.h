@@ -3,9 +3,51 @@
 
 #include <vector>
 #include "tree_node.h"  
+#include "thread_pool.h"
+#include "buffers.h"
+#include "packed_codes.h"
 
 using namespace std;
 
-vector<TreeNode*> create_index(int K, int L, int n, const vector<vector<vector<int>>>& EP, int max_size);
+// Mayor K admitido: el hijo de la raíz se calcula en un int de K bits y los
+// códigos de un punto se desempaquetan en buffers de 32 bytes
+const int MAX_K = 30;
 
-#endif // CREATE_INDEX_H
\ No newline at end of file
+// Bits que ocupa un código de región con Nr regiones
+int code_bits(int Nr);
+
+// Hijo de la raíz de un punto: el bit más alto de cada una de sus K
+// coordenadas (la dimensión 0 es el bit más significativo del índice)
+int root_child(const uint8_t* epi, int K, int bits);
+
+// Dimensión y bit que dividen una hoja a `depth` niveles bajo los hijos de
+// la raíz: las dimensiones se alternan y cada vuelta baja un bit.
+// Devuelve false si ya no quedan bits (todos los códigos de la hoja son iguales).
+bool split_at_depth(int depth, int K, int bits, int& dimension, int& bit);
+
+// Hoja del DE-Tree donde cae un punto codificado
+TreeNode* find_leaf(const DETree& tree, const uint8_t* epi);
+
+// Reparte las posiciones de una hoja según el bit de sus códigos en `codes`
+void splitNode(DETree& tree, const CodeView& codes, TreeNode* node, int dimension, int bit);
+
+// Crea los L árboles vacíos (cada raíz con 2^K hijos iniciales). Lanza
+// invalid_argument si K no está en [1, MAX_K] o Nr en [1, 256]; todas las
+// construcciones (create_index, bulk_load_index, streaming) pasan por aquí
+vector<DETree> init_index(int K, int L, int Nr, int max_size);
+
+// Inserta la posición `pos`; su código y los de la hoja se leen de `codes`
+void insert_point(DETree& tree, const CodeView& codes, int pos, int max_size);
+
+vector<DETree> create_index(int K, int L, int n, const CodeBuffer& EP, int Nr, int max_size, ThreadPool& pool = ThreadPool::shared());
+
+// Carga masiva: ordena los ids por su clave de códigos intercalados (radix
+// sort) y arma cada árbol en una pasada sobre el orden resultante, con hojas
+// de hasta fill·max_size puntos. El árbol obtenido sigue las mismas reglas
+// de división que insert_point, así que admite inserciones posteriores.
+vector<DETree> bulk_load_index(int K, int L, int n, const CodeBuffer& EP, int Nr, int max_size, double fill = 1.0, ThreadPool& pool = ThreadPool::shared());
+
+// Memoria de los L árboles (bloques de sus arenas)
+size_t index_bytes(const vector<DETree>& DETs);
+
+#endif // CREATE_INDEX_H
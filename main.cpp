@@ -8,7 +8,11 @@
 #include "LSH.h"
 #include "encoding.h"
 #include "indexing.h"
-#include "reader.h"
+#include "dataset.h"
+#include "vecs_mmap.h"
+#include "streaming_build.h"
+#include "packed_codes.h"
+#include "flat_tree.h"
 
 using namespace std;
 
@@ -23,13 +27,22 @@ double euclideanDistance(const Eigen::VectorXd& vec1, const Eigen::VectorXd& vec
     return (vec1 - vec2).norm();
 }
 
+double euclideanDistance(const float* vec1, const float* vec2, size_t d) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < d; ++i) {
+        float diff = vec1[i] - vec2[i];
+        sum += diff * diff;
+    }
+    return sqrt(static_cast<double>(sum));
+}
+
 /*
     Computar vecinos exactos
     Importante para el recall
 */
 vector<pair<int, double>> findKNearestNeighbors(
-    const Eigen::VectorXd& query,
-    const vector<Eigen::VectorXd>& dataset,
+    const float* query,
+    const DatasetView& dataset,
     int K) {
     if (K <= 0) {
         throw invalid_argument("K must be greater than 0.");
@@ -38,9 +51,9 @@ vector<pair<int, double>> findKNearestNeighbors(
     using Neighbor = pair<double, int>;
     priority_queue<Neighbor, vector<Neighbor>, greater<>> minHeap;
 
-    for (int i = 0; i < dataset.size(); ++i) {
-        double distance = euclideanDistance(query, dataset[i]);
-        minHeap.push({distance, i});
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        double distance = euclideanDistance(query, dataset.row(i), dataset.dim());
+        minHeap.push({distance, static_cast<int>(i)});
     }
 
     vector<pair<int, double>> kNearestNeighbors;
@@ -53,13 +66,13 @@ vector<pair<int, double>> findKNearestNeighbors(
 }
 
 // PARA EL CALCULO DEL RECALL
-vector<int> kNearestNeighbors(const Eigen::VectorXd& query, const vector<Eigen::VectorXd>& dataset, int K) {
+vector<int> kNearestNeighbors(const float* query, const DatasetView& dataset, int K) {
     using Neighbor = pair<double, int>; // {distancia, índice}
     priority_queue<Neighbor, vector<Neighbor>, greater<>> minHeap;
 
-    for (int i = 0; i < dataset.size(); ++i) {
-        double distance = euclideanDistance(query, dataset[i]);
-        minHeap.push({distance, i});
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        double distance = euclideanDistance(query, dataset.row(i), dataset.dim());
+        minHeap.push({distance, static_cast<int>(i)});
     }
 
     vector<int> neighbors;
@@ -115,13 +128,15 @@ set<int> simulateSystem(const set<int>& groundTruth, int datasetSize, double min
 
 void test_query(string dataset_path, string query_path, string name) {
 
-    vector<Eigen::VectorXd> dataset = readFVECS(dataset_path);
-    Eigen::VectorXd query = readFVECS(query_path)[0];
+    MappedVecs base_file(dataset_path);
+    MappedVecs query_file(query_path);
+    DatasetView dataset = base_file.fvecs();
+    const float* query = query_file.fvecs().row(0);
 
 
 
     int datasetSize = dataset.size(); // Tamaño total del dataset
-    int vectorDim = dataset[0].size();     // Dimensión de cada vector
+    int vectorDim = dataset.dim();     // Dimensión de cada vector
 
 
     int K = 50;
@@ -155,13 +170,14 @@ void test_query(string dataset_path, string query_path, string name) {
 
 void test_encoding(string dataset_path, string name) {
 
-    vector<Eigen::VectorXd> dataset = readFVECS(dataset_path);
+    MappedVecs base_file(dataset_path);
+    DatasetView dataset = base_file.fvecs();
 
     int K = 16;
     int L = 4;
-    int d = dataset[0].size();
+    int d = dataset.dim();
     double w = 5.0;
-    LSH lsh(K, L, d, w);
+    LSH lsh(K, L, d, w, DEFAULT_LSH_SEED);
 
     cout << "Dataset " << name << endl;
 
@@ -175,40 +191,98 @@ void test_encoding(string dataset_path, string name) {
     auto encodings = dynamic_encoding(K, L, dataset.size(), projected_points, ns, Nr);
     cout << "Non optimized" << endl;
     encodings = dynamic_encoding_non_optimized(K, L, dataset.size(), projected_points, ns, Nr);
+    cout << "Sketch (all n values)" << endl;
+    auto B = breakpoints_selection_sketch(K, L, dataset.size(), projected_points, Nr);
+    encodings = encode_with_breakpoints(K, L, dataset.size(), projected_points, B, Nr);
+}
+
+// Hojas no vacías de los DE-Trees y cuánto se llenan respecto de max_size
+void leaf_occupancy(const vector<DETree>& DETs, int max_size) {
+    size_t leaves = 0, entries = 0;
+    vector<TreeNode*> stack;
+    for (const DETree& tree : DETs) {
+        stack.push_back(tree.root);
+    }
+    while (!stack.empty()) {
+        TreeNode* node = stack.back();
+        stack.pop_back();
+        if (node->is_leaf()) {
+            if (node->count > 0) {
+                leaves++;
+                entries += node->count;
+            }
+            continue;
+        }
+        stack.insert(stack.end(), node->children, node->children + node->child_count);
+        if (node->left) stack.push_back(node->left);
+        if (node->right) stack.push_back(node->right);
+    }
+    cout << "Leaves: " << leaves << " (average occupancy "
+         << (leaves ? 100.0 * entries / (leaves * max_size) : 0.0) << "%), index "
+         << index_bytes(DETs) << " bytes" << endl;
 }
 
 void test_indexing(string dataset_path, string name) {
 
-    vector<Eigen::VectorXd> dataset = readFVECS(dataset_path);
+    MappedVecs base_file(dataset_path);
+    DatasetView dataset = base_file.fvecs();
 
     int K = 16;
     int L = 4;
-    int d = dataset[0].size();
+    int d = dataset.dim();
     double w = 5.0;
-    LSH lsh(K, L, d, w);
+    LSH lsh(K, L, d, w, DEFAULT_LSH_SEED);
 
     cout << "Dataset " << name << endl;
 
     /* 3. LSH proyecta todos los puntos en L espacios. */
     auto projected_points = lsh.project_dataset(dataset);
 
-    /* 4. Codifica todos lo puntos. */
-    int ns = 20;
+    /* 4. Codifica todos lo puntos con breakpoints de igual frecuencia. */
     int Nr = 8;
-    cout << "Optimized" << endl;
-    auto encodings = dynamic_encoding(K, L, dataset.size(), projected_points, ns, Nr);
-    cout << "Non optimized" << endl;
-    encodings = dynamic_encoding_non_optimized(K, L, dataset.size(), projected_points, ns, Nr);
+    auto B = breakpoints_selection_sketch(K, L, dataset.size(), projected_points, Nr);
+    auto encodings = encode_with_breakpoints(K, L, dataset.size(), projected_points, B, Nr);
+    PackedCodes packed = PackedCodes::pack(encodings, Nr);
+    cout << "Packed codes: " << packed.bytes() << " bytes ("
+         << packed.bytes() / dataset.size() << " bytes per point, "
+         << packed.bits() << "-bit lanes)" << endl;
 
     /* 5. Indexacion */
     int n = dataset.size();
     int max_size = 20;
 
-    // segmentation fall
-    auto index = create_index(K, L, n, encodings, max_size);
+    cout << "Point by point" << endl;
+    auto index = create_index(K, L, n, encodings, Nr, max_size);
+    leaf_occupancy(index, max_size);
+    cout << "Bulk loading" << endl;
+    auto bulk = bulk_load_index(K, L, n, encodings, Nr, max_size);
+    leaf_occupancy(bulk, max_size);
+    auto flat = flatten_index(bulk, packed, B);
+    cout << "Flat DE-Trees: " << flat[0].node_count() << " nodes, "
+         << flat[0].bytes() << " bytes per tree" << endl;
 
 }
 
+void test_streaming_indexing(string dataset_path, string name, size_t memory_budget) {
+
+    MappedVecs base_file(dataset_path);
+
+    int K = 16;
+    int L = 4;
+    int d = base_file.dim();
+    double w = 5.0;
+    LSH lsh(K, L, d, w, DEFAULT_LSH_SEED);
+
+    cout << "Dataset " << name << " (streaming)" << endl;
+
+    StreamingBuildConfig config;
+    config.memory_budget = memory_budget;
+    config.Nr = 8;
+    config.max_size = 20;
+
+    auto index = streaming_build_index(dataset_path, lsh, K, L, config);
+}
+
 
 int main() {
 
@@ -225,6 +299,12 @@ int main() {
     //     "movilens"
     // );
 
+    // test_streaming_indexing(
+    //     "./datasets/deep1M/deep1M_base.fvecs",
+    //     "deep1M",
+    //     size_t(64) << 20
+    // );
+
 
     // test_query(
     //     "./datasets/movielens/movielens_base.fvecs",
@@ -0,0 +1,127 @@
+#include "packed_codes.h"
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Patrón que repite `lane` (de `width` < 64 bits) en toda la palabra
+inline uint64_t repeat(uint64_t lane, int width) {
+    return lane * (~uint64_t(0) / ((uint64_t(1) << width) - 1));
+}
+
+// Bits bajos de cada carril: 0x1111... (4 bits) o 0x0101... (8 bits)
+inline uint64_t low_bits(int bits) {
+    return repeat(1, bits);
+}
+
+// Carriles pares e impares por separado, cada uno en un carril del doble
+// de ancho, así la resta de abajo no pide prestado al carril vecino
+inline uint64_t even_lanes(uint64_t word, int bits) {
+    return word & repeat((uint64_t(1) << bits) - 1, 2 * bits);
+}
+
+inline uint64_t odd_lanes(uint64_t word, int bits) {
+    return (word >> bits) & repeat((uint64_t(1) << bits) - 1, 2 * bits);
+}
+
+// Todos los carriles de x >= y (carriles de 2·bits con valores < 2^bits)
+inline bool all_greater_equal(uint64_t x, uint64_t y, int bits) {
+    const uint64_t high = repeat(uint64_t(1) << (2 * bits - 1), 2 * bits);
+    return (((x | high) - y) & high) == high;
+}
+
+inline int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    int count = 0;
+    while (x) { x &= x - 1; count++; }
+    return count;
+#endif
+}
+
+} // namespace
+
+PackedCodes::PackedCodes(size_t L, size_t n, size_t K, int Nr)
+    : L(L), n(n), K(K), lane_bits(bits_for_regions(Nr)) {
+    if (Nr < 1 || Nr > 256) {
+        throw invalid_argument("Nr must be between 1 and 256 to pack codes");
+    }
+    const size_t per_word = 64 / lane_bits;
+    words = (K + per_word - 1) / per_word;
+    storage.assign(L * n * words, 0);
+}
+
+PackedCodes PackedCodes::pack(const CodeBuffer& codes, int Nr) {
+    PackedCodes packed(codes.spaces(), codes.size(), codes.dims(), Nr);
+    for (size_t i = 0; i < packed.L; ++i) {
+        for (size_t idx = 0; idx < packed.n; ++idx) {
+            packed.pack_row(i, idx, codes.row(i, idx));
+        }
+    }
+    return packed;
+}
+
+void PackedCodes::set(size_t i, size_t idx, size_t j, uint8_t code) {
+    const size_t per_word = 64 / lane_bits;
+    const size_t shift = (j % per_word) * lane_bits;
+    const uint64_t mask = ((uint64_t(1) << lane_bits) - 1) << shift;
+    uint64_t& word = row(i, idx)[j / per_word];
+    word = (word & ~mask) | ((static_cast<uint64_t>(code) << shift) & mask);
+}
+
+void PackedCodes::pack_row(size_t i, size_t idx, const uint8_t* codes) {
+    const size_t per_word = 64 / lane_bits;
+    uint64_t* out = row(i, idx);
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t word = 0;
+        for (size_t t = 0; t < per_word && w * per_word + t < K; ++t) {
+            word |= static_cast<uint64_t>(codes[w * per_word + t]) << (t * lane_bits);
+        }
+        out[w] = word;
+    }
+}
+
+void PackedCodes::unpack_row(size_t i, size_t idx, uint8_t* out) const {
+    const uint64_t* packed = row(i, idx);
+    for (size_t j = 0; j < K; ++j) {
+        out[j] = lane(packed, j, lane_bits);
+    }
+}
+
+
+bool packed_equal(const uint64_t* a, const uint64_t* b, size_t words) {
+    uint64_t diff = 0;
+    for (size_t w = 0; w < words; ++w) {
+        diff |= a[w] ^ b[w];
+    }
+    return diff == 0;
+}
+
+int packed_matching_lanes(const uint64_t* a, const uint64_t* b, size_t words, int bits, size_t K) {
+    // Un bit por carril distinto: se pliega cada carril sobre su bit bajo
+    int different = 0;
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t diff = a[w] ^ b[w];
+        uint64_t folded = diff;
+        for (int s = 1; s < bits; ++s) {
+            folded |= diff >> s;
+        }
+        different += popcount64(folded & low_bits(bits));
+    }
+    return static_cast<int>(K) - different;
+}
+
+bool packed_in_box(const uint64_t* code, const uint64_t* lo, const uint64_t* hi, size_t words, int bits) {
+    for (size_t w = 0; w < words; ++w) {
+        const uint64_t x = code[w];
+        if (!all_greater_equal(even_lanes(x, bits), even_lanes(lo[w], bits), bits) ||
+            !all_greater_equal(odd_lanes(x, bits), odd_lanes(lo[w], bits), bits) ||
+            !all_greater_equal(even_lanes(hi[w], bits), even_lanes(x, bits), bits) ||
+            !all_greater_equal(odd_lanes(hi[w], bits), odd_lanes(x, bits), bits)) {
+            return false;
+        }
+    }
+    return true;
+}
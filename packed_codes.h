@@ -0,0 +1,99 @@
+#ifndef PACKED_CODES_H
+#define PACKED_CODES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "buffers.h"
+
+// Códigos de región empaquetados en palabras de 64 bits, [L][n][palabras].
+// Con Nr <= 16 cada código ocupa 4 bits y con Nr <= 256, 8 bits; los K
+// códigos de un punto en un árbol quedan seguidos y ningún código cruza
+// el borde de una palabra. Con L = 4 y K = 16 un punto ocupa 32 bytes
+// (4 bits) o 64 bytes (8 bits) en todo el índice.
+class PackedCodes {
+public:
+    PackedCodes() = default;
+    PackedCodes(size_t L, size_t n, size_t K, int Nr);
+
+    // Empaqueta un CodeBuffer completo
+    static PackedCodes pack(const CodeBuffer& codes, int Nr);
+
+    // Bits por código según el número de regiones
+    static int bits_for_regions(int Nr) { return Nr <= 16 ? 4 : 8; }
+
+    size_t spaces() const { return L; }
+    size_t size() const { return n; }
+    size_t dims() const { return K; }
+    int bits() const { return lane_bits; }
+    size_t words_per_row() const { return words; }
+    size_t bytes() const { return storage.size() * sizeof(uint64_t); }
+
+    const uint64_t* row(size_t i, size_t idx) const { return storage.data() + (i * n + idx) * words; }
+    uint64_t* row(size_t i, size_t idx) { return storage.data() + (i * n + idx) * words; }
+
+    uint8_t get(size_t i, size_t idx, size_t j) const { return lane(row(i, idx), j, lane_bits); }
+    void set(size_t i, size_t idx, size_t j, uint8_t code);
+
+    // Copia los K códigos de una fila a bytes sueltos
+    void unpack_row(size_t i, size_t idx, uint8_t* out) const;
+    // Empaqueta K códigos sueltos en una fila
+    void pack_row(size_t i, size_t idx, const uint8_t* codes);
+
+    static uint8_t lane(const uint64_t* row, size_t j, int bits) {
+        const size_t per_word = 64 / bits;
+        const uint64_t mask = (uint64_t(1) << bits) - 1;
+        return static_cast<uint8_t>((row[j / per_word] >> ((j % per_word) * bits)) & mask);
+    }
+
+private:
+    size_t L = 0, n = 0, K = 0;
+    int lane_bits = 8;
+    size_t words = 0;
+    std::vector<uint64_t> storage;
+};
+
+// Lectura de los códigos de un espacio i, desde un CodeBuffer (un byte por
+// código) o desde PackedCodes. Es una vista: no copia ni es dueña de los datos.
+class CodeView {
+public:
+    CodeView() = default;
+    CodeView(const CodeBuffer& codes, size_t i)
+        : bytes(codes.row(i, 0)), stride(codes.dims()), K(codes.dims()) {}
+    CodeView(const PackedCodes& codes, size_t i)
+        : words(codes.row(i, 0)), stride(codes.words_per_row()), bits(codes.bits()), K(codes.dims()) {}
+
+    size_t dims() const { return K; }
+
+    uint8_t get(size_t idx, size_t j) const {
+        return bytes ? bytes[idx * stride + j] : PackedCodes::lane(words + idx * stride, j, bits);
+    }
+
+    void unpack(size_t idx, uint8_t* out) const {
+        for (size_t j = 0; j < K; ++j) {
+            out[j] = get(idx, j);
+        }
+    }
+
+private:
+    const uint8_t* bytes = nullptr;
+    const uint64_t* words = nullptr;
+    size_t stride = 0;
+    int bits = 8;
+    size_t K = 0;
+};
+
+// Comparaciones que trabajan directamente sobre las palabras empaquetadas.
+// Los carriles sobrantes de la última palabra deben estar en cero (así
+// los deja PackedCodes) para que no afecten el resultado.
+
+// Todas las coordenadas iguales
+bool packed_equal(const uint64_t* a, const uint64_t* b, size_t words);
+
+// Cantidad de coordenadas con el mismo código
+int packed_matching_lanes(const uint64_t* a, const uint64_t* b, size_t words, int bits, size_t K);
+
+// lo[j] <= code[j] <= hi[j] para todas las coordenadas (lo y hi empaquetados igual)
+bool packed_in_box(const uint64_t* code, const uint64_t* lo, const uint64_t* hi, size_t words, int bits);
+
+#endif // PACKED_CODES_H
@@ -4,6 +4,8 @@
 #include <vector>
 #include <cmath>
 #include <functional>
+#include <stdexcept>
+#include <utility>
 
 struct Point {
     std::vector<double> coordinates;  // Coordenadas del punto
@@ -11,7 +13,7 @@ struct Point {
     Point() = default;
 
     // Constructor
-    Point(std::vector<double> coords) : coordinates(coords) {}
+    Point(std::vector<double> coords) : coordinates(std::move(coords)) {}
 
     double distance_squared_to(const Point& other) const {
         double sum = 0.0;
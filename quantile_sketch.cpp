@@ -0,0 +1,127 @@
+#include "quantile_sketch.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace std;
+
+KLLSketch::KLLSketch(int k, uint64_t seed)
+    : k(std::max(k, 8)), rng_state(seed | 1), levels(1) {}
+
+bool KLLSketch::random_bit() {
+    // xorshift64: barato y reproducible
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state & 1;
+}
+
+// Los niveles altos guardan más elementos; cada nivel inferior (2/3)^h menos
+size_t KLLSketch::capacity(size_t level) const {
+    const size_t depth = levels.size() - level - 1;
+    return std::max<size_t>(2, static_cast<size_t>(ceil(k * pow(2.0 / 3.0, depth))));
+}
+
+size_t KLLSketch::retained() const {
+    size_t total = 0;
+    for (const auto& level : levels) total += level.size();
+    return total;
+}
+
+void KLLSketch::update(float value) {
+    if (n == 0) {
+        min_value = max_value = value;
+    } else {
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+    }
+    n++;
+    levels[0].push_back(value);
+    if (levels[0].size() >= capacity(0)) {
+        compress();
+    }
+}
+
+// Compacta los niveles llenos: ordena, se queda con la mitad (pares o
+// impares, al azar) y la sube al siguiente nivel con el doble de peso
+void KLLSketch::compress() {
+    for (size_t h = 0; h < levels.size(); ++h) {
+        if (levels[h].size() < capacity(h)) continue;
+        if (h + 1 == levels.size()) {
+            levels.emplace_back();
+        }
+
+        vector<float>& level = levels[h];
+        sort(level.begin(), level.end());
+
+        // Con tamaño impar el último elemento se queda en su nivel
+        size_t even = level.size() & ~size_t(1);
+        size_t offset = random_bit() ? 1 : 0;
+        for (size_t t = offset; t < even; t += 2) {
+            levels[h + 1].push_back(level[t]);
+        }
+        if (even < level.size()) {
+            float leftover = level.back();
+            level.clear();
+            level.push_back(leftover);
+        } else {
+            level.clear();
+        }
+    }
+}
+
+void KLLSketch::merge(const KLLSketch& other) {
+    if (other.n == 0) return;
+    if (n == 0) {
+        min_value = other.min_value;
+        max_value = other.max_value;
+    } else {
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+    }
+    n += other.n;
+
+    if (levels.size() < other.levels.size()) {
+        levels.resize(other.levels.size());
+    }
+    for (size_t h = 0; h < other.levels.size(); ++h) {
+        levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+    }
+    compress();
+}
+
+vector<float> KLLSketch::quantiles(const vector<double>& qs) const {
+    vector<float> result(qs.size(), 0.0f);
+    if (n == 0) return result;
+
+    // Elementos retenidos con su peso, ordenados por valor
+    vector<pair<float, uint64_t>> weighted;
+    weighted.reserve(retained());
+    for (size_t h = 0; h < levels.size(); ++h) {
+        for (float value : levels[h]) {
+            weighted.push_back({value, uint64_t(1) << h});
+        }
+    }
+    sort(weighted.begin(), weighted.end());
+
+    uint64_t total = 0;
+    for (const auto& item : weighted) total += item.second;
+
+    size_t pos = 0;
+    uint64_t cumulative = 0;
+    for (size_t t = 0; t < qs.size(); ++t) {
+        if (qs[t] <= 0.0) { result[t] = min_value; continue; }
+        if (qs[t] >= 1.0) { result[t] = max_value; continue; }
+        const double target = qs[t] * total;
+        while (pos < weighted.size() && cumulative + weighted[pos].second < target) {
+            cumulative += weighted[pos].second;
+            pos++;
+        }
+        result[t] = weighted[std::min(pos, weighted.size() - 1)].first;
+    }
+    return result;
+}
+
+float KLLSketch::quantile(double q) const {
+    return quantiles({q})[0];
+}
@@ -0,0 +1,44 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sketch de cuantiles KLL (Karnin, Lang y Liberty, 2016).
+// Resume un flujo de valores en una pasada con memoria O(k log(n/k)) y
+// error de rango ~O(1/k). Dos sketches se pueden combinar con merge(),
+// así que cada hilo resume su parte del dataset y al final se juntan.
+// Las compactaciones usan un generador propio con semilla, por lo que el
+// resultado es determinista para el mismo orden de update/merge.
+class KLLSketch {
+public:
+    explicit KLLSketch(int k = 200, uint64_t seed = 0x5DEECE66DULL);
+
+    void update(float value);
+    void merge(const KLLSketch& other);
+
+    // Valor cuyo rango normalizado es q en [0, 1]
+    float quantile(double q) const;
+    // Varios cuantiles de una sola vez (qs ordenados de menor a mayor)
+    std::vector<float> quantiles(const std::vector<double>& qs) const;
+
+    uint64_t count() const { return n; }
+    float min() const { return min_value; }
+    float max() const { return max_value; }
+    size_t retained() const;
+
+private:
+    int k;
+    uint64_t n = 0;
+    uint64_t rng_state;
+    float min_value = 0.0f;
+    float max_value = 0.0f;
+    std::vector<std::vector<float>> levels;  // levels[h] tiene peso 2^h
+
+    size_t capacity(size_t level) const;
+    void compress();
+    bool random_bit();
+};
+
+#endif // QUANTILE_SKETCH_H
@@ -1,8 +1,12 @@
+#ifndef READER_H
+#define READER_H
+
 #include <Eigen/Dense>
 #include <fstream>
 #include <vector>
+#include "dataset.h"
 
-std::vector<Eigen::VectorXd> readFVECS(const std::string& filename) {
+inline std::vector<Eigen::VectorXd> readFVECS(const std::string& filename) {
     std::vector<Eigen::VectorXd> vectors;
 
     std::ifstream file(filename, std::ios::binary);
@@ -34,4 +38,6 @@ std::vector<Eigen::VectorXd> readFVECS(const std::string& filename) {
     }
 
     return vectors;
-}
\ No newline at end of file
+}
+
+#endif // READER_H
@@ -0,0 +1,75 @@
+#include "region_bounds.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+RegionBounds::RegionBounds(const vector<vector<double>>& Bi)
+    : K(static_cast<int>(Bi.size())), Nr(Bi.empty() ? 0 : static_cast<int>(Bi[0].size()) - 1) {
+    edges.reserve(size_t(K) * (Nr + 1));
+    for (const auto& Bij : Bi) {
+        edges.insert(edges.end(), Bij.begin(), Bij.end());
+    }
+}
+
+double RegionBounds::lower_bound2(const double* q, const uint8_t* lo, const uint8_t* hi) const {
+    double sum = 0.0;
+    for (int j = 0; j < K; ++j) {
+        if (lo[j] > hi[j]) {
+            return numeric_limits<double>::infinity();  // Caja vacía
+        }
+        double gap = 0.0;
+        if (lo[j] > 0 && q[j] < left(j, lo[j])) {
+            gap = left(j, lo[j]) - q[j];
+        } else if (hi[j] < Nr - 1 && q[j] > right(j, hi[j])) {
+            gap = q[j] - right(j, hi[j]);
+        }
+        sum += gap * gap;
+    }
+    return sum;
+}
+
+double RegionBounds::upper_bound2(const double* q, const uint8_t* lo, const uint8_t* hi) const {
+    double sum = 0.0;
+    for (int j = 0; j < K; ++j) {
+        if (lo[j] > hi[j]) {
+            return 0.0;  // Caja vacía
+        }
+        // Igual que en la cota inferior, las regiones de los extremos no
+        // tienen borde exterior: un punto fuera de la muestra puede estar
+        // tan lejos como sea
+        if (lo[j] == 0 || hi[j] == Nr - 1) {
+            return numeric_limits<double>::infinity();
+        }
+        double far = max(fabs(q[j] - left(j, lo[j])), fabs(q[j] - right(j, hi[j])));
+        sum += far * far;
+    }
+    return sum;
+}
+
+void QueryBounds::reset(const RegionBounds& bounds, const double* q) {
+    K = bounds.dims();
+    Nr = bounds.regions();
+    const size_t cells = size_t(K) * Nr;
+    lower_lo.resize(cells);
+    lower_hi.resize(cells);
+    upper_lo.resize(cells);
+    upper_hi.resize(cells);
+    point.resize(cells);
+    for (int j = 0; j < K; ++j) {
+        for (int r = 0; r < Nr; ++r) {
+            const size_t t = size_t(j) * Nr + r;
+            const double left = bounds.left(j, r);
+            const double right = bounds.right(j, r);
+            // Las regiones de los extremos son abiertas para la cota inferior...
+            const double gap_lo = (r > 0 && q[j] < left) ? left - q[j] : 0.0;
+            const double gap_hi = (r < Nr - 1 && q[j] > right) ? q[j] - right : 0.0;
+            lower_lo[t] = gap_lo * gap_lo;
+            lower_hi[t] = gap_hi * gap_hi;
+            // y también para la superior: una caja que toca la región 0 o la
+            // Nr - 1 no tiene cota superior finita
+            upper_lo[t] = r > 0 ? (q[j] - left) * (q[j] - left) : numeric_limits<double>::infinity();
+            upper_hi[t] = r < Nr - 1 ? (q[j] - right) * (q[j] - right) : numeric_limits<double>::infinity();
+            point[t] = lower_lo[t] + lower_hi[t];
+        }
+    }
+}
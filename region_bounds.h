@@ -0,0 +1,138 @@
+#ifndef REGION_BOUNDS_H
+#define REGION_BOUNDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+// Cotas de distancia entre una consulta proyectada q' y una caja de
+// regiones: en cada dimensión j, las regiones [lo[j], hi[j]] cubren el
+// intervalo [B[j][lo[j]], B[j][hi[j] + 1]] del espacio proyectado.
+// Todas las distancias se devuelven al cuadrado.
+class RegionBounds {
+public:
+    RegionBounds() = default;
+
+    // Breakpoints B[i] de un espacio, [K][Nr + 1]
+    explicit RegionBounds(const vector<vector<double>>& Bi);
+    // Los mismos breakpoints desde un arreglo plano [K][Nr + 1]
+    RegionBounds(int K, int Nr, const double* edges)
+        : K(K), Nr(Nr), edges(edges, edges + size_t(K) * (Nr + 1)) {}
+
+    int dims() const { return K; }
+    int regions() const { return Nr; }
+
+    // Breakpoints B[j] de la dimensión j (Nr + 1 valores)
+    const double* row(int j) const { return edges.data() + size_t(j) * (Nr + 1); }
+
+    // Borde izquierdo de la región r y derecho de la región r (B[j][r], B[j][r + 1])
+    double left(int j, int r) const { return edges[size_t(j) * (Nr + 1) + r]; }
+    double right(int j, int r) const { return edges[size_t(j) * (Nr + 1) + r + 1]; }
+
+    // Cota inferior: las regiones de los extremos se tratan como abiertas
+    // (un punto fuera de la muestra de los breakpoints cae en ellas), así
+    // que nunca descarta un punto de la caja
+    double lower_bound2(const double* q, const uint8_t* lo, const uint8_t* hi) const;
+
+    // Cota superior: inf si la caja toca la región 0 o la Nr - 1 en alguna
+    // dimensión, porque esas regiones también son abiertas
+    double upper_bound2(const double* q, const uint8_t* lo, const uint8_t* hi) const;
+
+private:
+    int K = 0;
+    int Nr = 0;
+    vector<double> edges;  // [K][Nr + 1]
+};
+
+// Tablas de una consulta q' para un espacio: con los breakpoints fijos, la
+// contribución de cada región r de cada dimensión j a las cotas no cambia,
+// así que se calcula una vez por consulta y por árbol ([K][Nr] cada tabla).
+// Una caja cuesta dos búsquedas por dimensión y un punto, una. Los
+// resultados coinciden con los de RegionBounds.
+class QueryBounds {
+public:
+    QueryBounds() = default;
+    QueryBounds(const RegionBounds& bounds, const double* q) { reset(bounds, q); }
+
+    // Rehace las tablas para otra consulta (u otro árbol) sobre los mismos
+    // buffers: con el mismo K y Nr no se vuelve a reservar memoria
+    void reset(const RegionBounds& bounds, const double* q);
+
+    // Cotas al cuadrado de una caja de regiones (lo, hi)
+    double lower2(const uint8_t* lo, const uint8_t* hi) const {
+        if (lo[0] > hi[0]) {
+            return numeric_limits<double>::infinity();  // Caja vacía
+        }
+        double sum = 0.0;
+        for (int j = 0; j < K; ++j) {
+            sum += lower_lo[j * Nr + lo[j]] + lower_hi[j * Nr + hi[j]];
+        }
+        return sum;
+    }
+
+    double upper2(const uint8_t* lo, const uint8_t* hi) const {
+        if (lo[0] > hi[0]) {
+            return 0.0;
+        }
+        double sum = 0.0;
+        for (int j = 0; j < K; ++j) {
+            sum += max(upper_lo[j * Nr + lo[j]], upper_hi[j * Nr + hi[j]]);
+        }
+        return sum;
+    }
+
+    // Si la cota inferior al cuadrado de la región de un punto (códigos
+    // empaquetados en carriles de `bits`) no pasa de r2. Corta la suma en
+    // cuanto la pasa, revisando al final de cada palabra de códigos
+    bool point_within(const uint64_t* row, int bits, double r2) const {
+        const int per_word = 64 / bits;
+        const uint64_t mask = (uint64_t(1) << bits) - 1;
+        double sum = 0.0;
+        for (int j0 = 0; j0 < K; j0 += per_word) {
+            uint64_t word = row[j0 / per_word];
+            const int j1 = min(K, j0 + per_word);
+            for (int j = j0; j < j1; ++j, word >>= bits) {
+                sum += point[j * Nr + static_cast<int>(word & mask)];
+            }
+            if (sum > r2) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Cota inferior al cuadrado completa de un punto con códigos empaquetados
+    double point_lower2(const uint64_t* row, int bits) const {
+        const int per_word = 64 / bits;
+        const uint64_t mask = (uint64_t(1) << bits) - 1;
+        double sum = 0.0;
+        for (int j = 0; j < K; ++j) {
+            sum += point[j * Nr + static_cast<int>((row[j / per_word] >> ((j % per_word) * bits)) & mask)];
+        }
+        return sum;
+    }
+
+    // Cota inferior al cuadrado de la región de un punto
+    double point_lower2(const uint8_t* code) const {
+        double sum = 0.0;
+        for (int j = 0; j < K; ++j) {
+            sum += point[j * Nr + code[j]];
+        }
+        return sum;
+    }
+
+private:
+    int K = 0;
+    int Nr = 0;
+    // Distancias al cuadrado, [K][Nr]
+    vector<double> lower_lo;  // Al borde izquierdo si q' queda a la izquierda
+    vector<double> lower_hi;  // Al borde derecho si q' queda a la derecha
+    vector<double> upper_lo;  // Al borde izquierdo (inf en la región 0)
+    vector<double> upper_hi;  // Al borde derecho (inf en la región Nr - 1)
+    vector<double> point;     // lower_lo + lower_hi: cota de una sola región
+};
+
+#endif // REGION_BOUNDS_H
@@ -0,0 +1,134 @@
+#include "rerank.h"
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Candidatos de adelanto para el prefetch: suficiente para cubrir la
+// latencia de memoria de una fila mientras se calculan las anteriores
+const size_t PREFETCH_AHEAD = 8;
+
+inline void prefetch_row(const float* row, size_t d) {
+#if defined(__GNUC__) || defined(__clang__)
+    const char* bytes = reinterpret_cast<const char*>(row);
+    for (size_t offset = 0; offset < d * sizeof(float); offset += 64) {
+        __builtin_prefetch(bytes + offset);
+    }
+#else
+    (void)row;
+    (void)d;
+#endif
+}
+
+} // namespace
+
+float squared_l2_scalar(const float* a, const float* b, size_t d) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < d; ++i) {
+        const float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+float squared_l2(const float* a, const float* b, size_t d) {
+    size_t i = 0;
+
+#if defined(__AVX512F__)
+    // Dos acumuladores para no encadenar cada FMA con la anterior
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    for (; i + 32 <= d; i += 32) {
+        const __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        const __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= d; i += 16) {
+        const __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+    }
+    // La cola va enmascarada: los carriles de más se cargan en cero
+    if (i < d) {
+        const __mmask16 tail = static_cast<__mmask16>((1u << (d - i)) - 1);
+        const __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, a + i), _mm512_maskz_loadu_ps(tail, b + i));
+        acc1 = _mm512_fmadd_ps(d0, d0, acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+#elif defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= d; i += 16) {
+        const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+#if defined(__FMA__)
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+#else
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+#endif
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    for (; i + 8 <= d; i += 8) {
+        const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(d0, d0));
+    }
+    // Suma horizontal de los 8 carriles
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    float sum = _mm_cvtss_f32(half);
+    for (; i < d; ++i) {
+        const float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+#else
+    return squared_l2_scalar(a, b, d);
+#endif
+}
+
+const char* distance_kernel_name() {
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+void rerank_into(const float* q, const DatasetView& dataset, const uint32_t* ids, size_t count, TopK& top) {
+    const size_t d = dataset.dim();
+
+    for (size_t t = 0; t < std::min(count, PREFETCH_AHEAD); ++t) {
+        prefetch_row(dataset.row(ids[t]), d);
+    }
+    for (size_t t = 0; t < count; ++t) {
+        if (t + PREFETCH_AHEAD < count) {
+            prefetch_row(dataset.row(ids[t + PREFETCH_AHEAD]), d);
+        }
+        top.push(squared_l2(q, dataset.row(ids[t]), d), ids[t]);
+    }
+}
+
+std::vector<std::pair<int, double>> to_neighbors(const std::vector<TopK::Entry>& sorted) {
+    // La raíz solo se saca para los k que se devuelven
+    std::vector<std::pair<int, double>> nearest;
+    nearest.reserve(sorted.size());
+    for (const TopK::Entry& entry : sorted) {
+        nearest.push_back({static_cast<int>(entry.second), std::sqrt(static_cast<double>(entry.first))});
+    }
+    return nearest;
+}
+
+std::vector<std::pair<int, double>> rerank(const float* q, const DatasetView& dataset,
+                                           const uint32_t* ids, size_t count, size_t k) {
+    TopK top(k);
+    rerank_into(q, dataset, ids, count, top);
+    return to_neighbors(top.take_sorted());
+}
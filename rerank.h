@@ -0,0 +1,83 @@
+#ifndef RERANK_H
+#define RERANK_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "dataset.h"
+
+// Distancia L2 al cuadrado entre dos vectores float de dimensión d: 16
+// coordenadas por instrucción con AVX-512, 8 con AVX2 o una a una sin SIMD.
+float squared_l2(const float* a, const float* b, size_t d);
+
+// Variante escalar, siempre disponible (referencia para las pruebas)
+float squared_l2_scalar(const float* a, const float* b, size_t d);
+
+// "avx512", "avx2" o "scalar", según con qué se compiló
+const char* distance_kernel_name();
+
+// Los k pares (distancia², id) más chicos vistos hasta ahora, en un max-heap
+// de capacidad fija: cada candidato cuesta una comparación contra el peor y,
+// solo si entra, O(log k). Los empates se rompen por id, así que el
+// resultado no depende del orden en que llegan los candidatos.
+class TopK {
+public:
+    using Entry = std::pair<float, uint32_t>;
+
+    explicit TopK(size_t k) : k(k) { heap.reserve(k); }
+
+    size_t size() const { return heap.size(); }
+    bool full() const { return heap.size() == k; }
+
+    // Distancia² que hay que mejorar para entrar
+    float worst() const { return full() ? heap.front().first : std::numeric_limits<float>::infinity(); }
+
+    void push(float d2, uint32_t id) {
+        const Entry entry(d2, id);
+        if (heap.size() < k) {
+            heap.push_back(entry);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (k > 0 && entry < heap.front()) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = entry;
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    // Copia de los pares de menor a mayor distancia; el heap sigue igual
+    std::vector<Entry> sorted() const {
+        std::vector<Entry> entries = heap;
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    }
+
+    // Vacía el heap y devuelve sus pares de menor a mayor distancia
+    std::vector<Entry> take_sorted() {
+        std::sort_heap(heap.begin(), heap.end());
+        std::vector<Entry> sorted;
+        sorted.swap(heap);
+        return sorted;
+    }
+
+private:
+    size_t k;
+    std::vector<Entry> heap;
+};
+
+// Distancia exacta de q a cada candidato, una sola vez por candidato y
+// pidiendo por adelantado las filas de los siguientes. Devuelve hasta k
+// pares {posición, distancia} ordenados por distancia.
+std::vector<std::pair<int, double>> rerank(const float* q, const DatasetView& dataset,
+                                           const uint32_t* ids, size_t count, size_t k);
+
+// Igual, pero agrega los candidatos a un top-k que se mantiene entre
+// llamadas (p. ej. entre radios de una misma consulta)
+void rerank_into(const float* q, const DatasetView& dataset, const uint32_t* ids, size_t count, TopK& top);
+
+// Pares de top como {posición, distancia}, de menor a mayor
+std::vector<std::pair<int, double>> to_neighbors(const std::vector<TopK::Entry>& sorted);
+
+#endif // RERANK_H
@@ -0,0 +1,228 @@
+#include "streaming_build.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include "encoding.h"
+#include "indexing.h"
+#include "quantile_sketch.h"
+
+using namespace std;
+using namespace std::chrono;
+
+ChunkReader::ChunkReader(const string& filename, size_t chunk_rows, size_t prefetch)
+    : file(filename, ios::binary | ios::ate),
+      format(vecs_format_from_path(filename)),
+      chunk_rows(max<size_t>(chunk_rows, 1)),
+      prefetch(max<size_t>(prefetch, 1)) {
+    if (!file.is_open()) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+    if (format == VecsFormat::IVECS) {
+        throw invalid_argument("ChunkReader only reads .fvecs and .bvecs: " + filename);
+    }
+
+    const size_t file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+    if (file_size > 0) {
+        int32_t dim = 0;
+        file.read(reinterpret_cast<char*>(&dim), sizeof(int32_t));
+        if (!file || dim <= 0) {
+            throw runtime_error("Invalid vecs header in " + filename);
+        }
+        d = static_cast<size_t>(dim);
+        const size_t element = format == VecsFormat::BVECS ? sizeof(uint8_t) : sizeof(float);
+        const size_t row_bytes = sizeof(int32_t) + d * element;
+        if (file_size % row_bytes != 0) {
+            throw runtime_error("Truncated vecs file: " + filename);
+        }
+        n = file_size / row_bytes;
+        file.seekg(0);
+    }
+
+    reader = thread(&ChunkReader::run, this);
+}
+
+ChunkReader::~ChunkReader() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+DatasetStore ChunkReader::read_chunk(size_t rows) {
+    DatasetStore chunk(rows, d);
+    vector<uint8_t> bytes(format == VecsFormat::BVECS ? d : 0);
+
+    for (size_t r = 0; r < rows; ++r) {
+        int32_t length = 0;
+        file.read(reinterpret_cast<char*>(&length), sizeof(int32_t));
+        if (static_cast<size_t>(length) != d) {
+            throw runtime_error("Inconsistent dimension in vecs file");
+        }
+        if (format == VecsFormat::FVECS) {
+            file.read(reinterpret_cast<char*>(chunk.row(r)), d * sizeof(float));
+        } else {
+            file.read(reinterpret_cast<char*>(bytes.data()), d);
+            copy(bytes.begin(), bytes.end(), chunk.row(r));
+        }
+        if (!file) {
+            throw runtime_error("Error reading data from file.");
+        }
+    }
+    return chunk;
+}
+
+void ChunkReader::run() {
+    try {
+        for (size_t first = 0; first < n; first += chunk_rows) {
+            // Esperar a que haya espacio en la cola de prefetch
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [&] { return stopping || ready.size() < prefetch; });
+                if (stopping) return;
+            }
+
+            DatasetStore chunk = read_chunk(min(chunk_rows, n - first));
+
+            {
+                lock_guard<mutex> lock(mtx);
+                ready.emplace_back(std::move(chunk), first);
+            }
+            cv.notify_all();
+        }
+    } catch (...) {
+        lock_guard<mutex> lock(mtx);
+        error = current_exception();
+    }
+
+    {
+        lock_guard<mutex> lock(mtx);
+        finished = true;
+    }
+    cv.notify_all();
+}
+
+bool ChunkReader::next(DatasetStore& chunk, size_t& first_row) {
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [&] { return !ready.empty() || finished; });
+
+    if (ready.empty()) {
+        if (error) rethrow_exception(error);
+        return false;
+    }
+
+    chunk = std::move(ready.front().first);
+    first_row = ready.front().second;
+    ready.pop_front();
+    lock.unlock();
+    cv.notify_all();
+    return true;
+}
+
+
+size_t chunk_rows_for_budget(size_t memory_budget, size_t d, int K, int L, size_t prefetch) {
+    const size_t floats_per_line = DatasetStore::ALIGNMENT / sizeof(float);
+    const size_t stride = (d + floats_per_line - 1) / floats_per_line * floats_per_line;
+
+    // Bloques en cola + el que lee el hilo + el que se procesa
+    const size_t chunk_bytes = stride * sizeof(float) * (prefetch + 2);
+    // ProjectionBuffer (float) y CodeBuffer (un byte por código) del bloque
+    // actual: L·K valores por fila en cada uno, sin reservas por fila. Los
+    // códigos empaquetados de los n puntos son parte del índice, como los árboles
+    const size_t buffer_bytes = size_t(L) * K * (sizeof(float) + sizeof(CodeBuffer::code_type));
+    const size_t row_bytes = chunk_bytes + buffer_bytes;
+
+    return max<size_t>(memory_budget / row_bytes, 1);
+}
+
+
+StreamingIndex streaming_build_index(const string& base_path, LSH& lsh, int K, int L, const StreamingBuildConfig& config) {
+
+    auto start = high_resolution_clock::now();
+
+    MappedVecs header(base_path);
+    const size_t chunk_rows = chunk_rows_for_budget(config.memory_budget, header.dim(), K, L, config.prefetch);
+
+    StreamingIndex index;
+    index.DETs = init_index(K, L, config.Nr, config.max_size);
+
+    DatasetStore chunk;
+    size_t first_row = 0;
+    size_t chunks = 0;
+    // Las proyecciones de cada bloque no imprimen nada; el total sale al final
+    ParallelStats chunk_stats;
+    double projection_us = 0.0;
+
+    // Primera pasada: cada bloque se resume en un sketch KLL por columna que
+    // se combina con los de los bloques anteriores, así que los breakpoints
+    // salen de todo el archivo y no solo de sus primeras filas. Cada columna
+    // combina los bloques en orden, con la semilla del bloque: el resultado
+    // no depende de los hilos y, con bloques de 65536 filas, coincide con
+    // breakpoints_selection_sketch
+    {
+        ChunkReader reader(base_path, chunk_rows, config.prefetch);
+        index.n = reader.size();
+        vector<KLLSketch> sketches(size_t(L) * K, KLLSketch(config.sketch_k));
+        while (reader.next(chunk, first_row)) {
+            const size_t rows = chunk.size();
+            ProjectionBuffer P = lsh.project_dataset(chunk.view(), chunk_stats);  // [L][K][rows]
+            projection_us += chunk_stats.wall_us;
+            ThreadPool::shared().parallel_for(L * K, 1, [&](size_t begin, size_t end) {
+                for (size_t column = begin; column < end; ++column) {
+                    KLLSketch part(config.sketch_k, chunks + 1);
+                    const float* values = P.column(column / K, column % K);
+                    for (size_t r = 0; r < rows; ++r) {
+                        part.update(values[r]);
+                    }
+                    sketches[column].merge(part);
+                }
+            });
+            chunks++;
+        }
+        index.B = breakpoints_from_sketches(K, L, sketches, config.Nr);
+    }
+
+    // Segunda pasada: con B fijo, cada bloque se vuelve a proyectar, se
+    // codifica y se agrega a los DE-Trees
+    index.codes = PackedCodes(L, index.n, K, config.Nr);
+    ChunkReader reader(base_path, chunk_rows, config.prefetch);
+    while (reader.next(chunk, first_row)) {
+        int rows = static_cast<int>(chunk.size());
+        ProjectionBuffer P = lsh.project_dataset(chunk.view(), chunk_stats);  // [L][K][rows]
+        projection_us += chunk_stats.wall_us;
+        CodeBuffer EP = encode_with_breakpoints(K, L, rows, P, index.B, config.Nr);
+
+        for (int i = 0; i < L; ++i) {
+            for (int r = 0; r < rows; ++r) {
+                index.codes.pack_row(i, first_row + r, EP.row(i, r));
+            }
+        }
+
+        // Un árbol por tarea; el orden de inserción dentro de cada árbol no cambia.
+        // Las hojas guardan posiciones y leen los códigos ya empaquetados
+        ThreadPool::shared().parallel_for(L, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                CodeView codes(index.codes, i);
+                for (int r = 0; r < rows; ++r) {
+                    insert_point(index.DETs[i], codes, static_cast<int>(first_row + r), config.max_size);
+                }
+            }
+        });
+    }
+
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(stop - start);
+
+    cout << "Streaming build: " << duration.count() << " microseconds ("
+         << chunks << " chunks of " << chunk_rows << " rows, projections "
+         << static_cast<long long>(projection_us) << " microseconds over both passes, index "
+         << index_bytes(index.DETs) << " bytes)" << endl;
+
+    return index;
+}
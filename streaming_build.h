@@ -0,0 +1,84 @@
+#ifndef STREAMING_BUILD_H
+#define STREAMING_BUILD_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dataset.h"
+#include "vecs_mmap.h"
+#include "tree_node.h"
+#include "packed_codes.h"
+#include "LSH.h"
+
+// Lee un archivo .fvecs/.bvecs por bloques de tamaño fijo.
+// Un hilo lector en segundo plano prepara hasta `prefetch` bloques por
+// adelantado mientras el bloque actual se procesa.
+class ChunkReader {
+public:
+    ChunkReader(const std::string& filename, size_t chunk_rows, size_t prefetch = 1);
+    ~ChunkReader();
+
+    ChunkReader(const ChunkReader&) = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    size_t size() const { return n; }
+    size_t dim() const { return d; }
+
+    // Entrega el siguiente bloque y la posición global de su primera fila.
+    // Devuelve false cuando ya no quedan bloques.
+    bool next(DatasetStore& chunk, size_t& first_row);
+
+private:
+    std::ifstream file;
+    VecsFormat format;
+    size_t n = 0;
+    size_t d = 0;
+    size_t chunk_rows;
+    size_t prefetch;
+
+    std::thread reader;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::pair<DatasetStore, size_t>> ready;
+    bool finished = false;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    void run();
+    DatasetStore read_chunk(size_t rows);
+};
+
+struct StreamingBuildConfig {
+    size_t memory_budget = size_t(256) << 20;  // Bytes para los bloques en vuelo
+    size_t prefetch = 1;                       // Bloques leídos por adelantado
+    int sketch_k = 200;                        // Precisión de los sketches KLL de los breakpoints
+    int Nr = 8;                                // Regiones por dimensión
+    int max_size = 20;                         // Tamaño máximo de las hojas
+};
+
+struct StreamingIndex {
+    vector<vector<vector<double>>> B;  // Breakpoints [L][K][Nr + 1]
+    vector<DETree> DETs;
+    PackedCodes codes;                 // Códigos de los n puntos, empaquetados
+    size_t n = 0;
+};
+
+// Filas por bloque para que los bloques en vuelo, sus proyecciones y sus
+// códigos no pasen de `memory_budget`. Los DE-Trees y los códigos
+// empaquetados no cuentan: el índice crece con n, pero la memoria de
+// trabajo de la construcción queda acotada.
+size_t chunk_rows_for_budget(size_t memory_budget, size_t d, int K, int L, size_t prefetch);
+
+// Construcción del índice fuera de memoria, en dos pasadas por bloques
+// sobre el archivo. La primera proyecta cada bloque y lo agrega a un sketch
+// KLL por columna, de donde salen los breakpoints de todo el dataset (como
+// breakpoints_selection_sketch). La segunda vuelve a proyectar cada bloque,
+// lo codifica con esos breakpoints y agrega los códigos a los DE-Trees.
+StreamingIndex streaming_build_index(const std::string& base_path, LSH& lsh, int K, int L, const StreamingBuildConfig& config);
+
+#endif // STREAMING_BUILD_H
@@ -3,20 +3,30 @@
 #include <random>
 #include <cassert>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 #include "tree_node.h" 
 #include "point.h"
 #include "Eigen/Dense"     
 #include "indexing.h"
 #include "encoding.h"
-#include "reader.h"
+#include "dataset.h"
+#include "vecs_mmap.h"
 #include "LSH.h"
 #include "ann_query.h"
+#include "DETRangeQuery.h"
+#include "candidate_set.h"
+#include "rerank.h"
+#include "index_file.h"
+#include "encode_kernel.h"
+#include "quantile_sketch.h"
+#include "streaming_build.h"
 
 using namespace std;
 using namespace std::chrono;
 
-vector<vector<vector<int>>> generate_random_EP(int K, int L, int n) {
-    vector<vector<vector<int>>> EP(n, vector<vector<int>>(L, vector<int>(K, 0)));
+CodeBuffer generate_random_EP(int K, int L, int n) {
+    CodeBuffer EP(L, n, K);
     random_device rd;
     mt19937 gen(rd());
     uniform_int_distribution<> dist(0, 1); // Generar bits aleatorios (0 o 1)
@@ -24,71 +34,97 @@ vector<vector<vector<int>>> generate_random_EP(int K, int L, int n) {
     for (int z = 0; z < n; z++) {
         for (int i = 0; i < L; i++) {
             for (int k = 0; k < K; k++) {
-                EP[z][i][k] = dist(gen); // Bits aleatorios
+                EP.at(i, z, k) = dist(gen); // Bits aleatorios
             }
         }
     }
     return EP;
 }
 
+// Dataset de n filas de dimensión d con valores sacados de `dist`
+template <typename Dist>
+DatasetStore random_dataset(size_t n, size_t d, mt19937& gen, Dist dist) {
+    DatasetStore data(n, d);
+    for (size_t z = 0; z < n; z++) {
+        for (size_t j = 0; j < d; j++) {
+            data.row(z)[j] = dist(gen);
+        }
+    }
+    return data;
+}
+
 // Contar puntos en el árbol
 int count_points(TreeNode* node) {
     if (!node) return 0;
 
     if (node->is_leaf()) {
-        return node->entries.size();
+        return node->count;
     }
 
     int count = 0;
     if (node->left) count += count_points(node->left);
     if (node->right) count += count_points(node->right);
-    for (TreeNode* child : node->children) {
-        count += count_points(child);
+    for (uint32_t c = 0; c < node->child_count; ++c) {
+        count += count_points(node->children[c]);
     }
 
     return count;
 }
 
+// Mismo árbol: misma forma, mismas divisiones y las mismas posiciones en
+// cada hoja, en el mismo orden
+bool same_tree(const TreeNode* a, const TreeNode* b) {
+    if (!a || !b) return a == b;
+    if (a->child_count != b->child_count || a->split_dimension != b->split_dimension ||
+        a->split_bit != b->split_bit || a->count != b->count) {
+        return false;
+    }
+    if (!equal(a->ids, a->ids + a->count, b->ids)) return false;
+    for (uint32_t c = 0; c < a->child_count; ++c) {
+        if (!same_tree(a->children[c], b->children[c])) return false;
+    }
+    return same_tree(a->left, b->left) && same_tree(a->right, b->right);
+}
+
 // Verificar que todos los puntos cumplan con las condiciones del nodo hoja
-void verify_leaf_conditions(TreeNode* node, int dimension, int bit) {
+void verify_leaf_conditions(TreeNode* node, const CodeView& codes, int dimension, int bit) {
     if (!node || !node->is_leaf()) return;
 
-    for (const auto& entry : node->entries) {
-        const Point& point = entry.first;
-        int bit_value = static_cast<int>(point.coordinates[dimension]) & (1 << bit);
+    for (uint32_t t = 0; t < node->count; ++t) {
+        int bit_value = codes.get(node->ids[t], dimension) & (1 << bit);
         assert(bit_value == 0 || bit_value == 1); // Verifica que el bit esté bien clasificado
     }
 }
 
 // Imprimir árbol para depuración
-void print_tree(TreeNode* node, int depth = 0, int node_id = 0) {
+void print_tree(TreeNode* node, const CodeView& codes, int depth = 0, int node_id = 0) {
     if (!node) return;
 
     string indent(depth * 2, ' ');
 
     if (node->is_leaf()) {
         cout << indent << "Leaf Node (ID: " << node_id << "):" << endl;
-        for (const auto& entry : node->entries) {
+        for (uint32_t t = 0; t < node->count; ++t) {
             cout << indent << "  Point: [";
-            for (size_t i = 0; i < entry.first.coordinates.size(); ++i) {
-                cout << entry.first.coordinates[i];
-                if (i < entry.first.coordinates.size() - 1) cout << ", ";
+            for (size_t i = 0; i < codes.dims(); ++i) {
+                cout << static_cast<int>(codes.get(node->ids[t], i));
+                if (i < codes.dims() - 1) cout << ", ";
             }
-            cout << "], Position: " << entry.second << endl;
+            cout << "], Position: " << node->ids[t] << endl;
         }
     } else {
         cout << indent << "Internal Node (ID: " << node_id << ")" << endl;
     }
 
     if (node->left) {
-        print_tree(node->left, depth + 1, node_id * 2 + 1);
+        print_tree(node->left, codes, depth + 1, node_id * 2 + 1);
     }
     if (node->right) {
-        print_tree(node->right, depth + 1, node_id * 2 + 2);
+        print_tree(node->right, codes, depth + 1, node_id * 2 + 2);
     }
-    for (size_t i = 0; i < node->children.size(); ++i) {
+    for (uint32_t i = 0; i < node->child_count; ++i) {
         cout << indent << "Child " << i << ":" << endl;
-        print_tree(node->children[i], depth + 1, node_id * 10 + i + 1);
+        print_tree(node->children[i], codes, depth + 1, node_id * 10 + i + 1);
     }
 }
 
@@ -99,39 +135,33 @@ void test_create_index_with_split() {
     int L = 1;       // Número de DE-Trees
     int n = 10;      // Número de puntos
     int max_size = 3; // Tamaño máximo de nodos hoja antes de dividir
+    int Nr = 2;      // Códigos de un bit
 
     // Generar un EP aleatorio
-    vector<vector<vector<int>>> EP = generate_random_EP(K, L, n);
+    CodeBuffer EP = generate_random_EP(K, L, n);
 
     // Crear el índice
-    vector<TreeNode*> DETs = create_index(K, L, n, EP, max_size);
+    vector<DETree> DETs = create_index(K, L, n, EP, Nr, max_size);
 
     // Verificar la estructura del árbol
-    TreeNode* root = DETs[0];
-    assert(root->children.size() == (1 << K)); // 2^K hijos iniciales en la raíz
+    TreeNode* root = DETs[0].root;
+    assert(root->child_count == (1u << K)); // 2^K hijos iniciales en la raíz
 
     // Imprimir el árbol
     cout << "Estructura del árbol:" << endl;
-    print_tree(root);
+    print_tree(root, CodeView(EP, 0));
 
     // Verificar que los puntos están insertados y los nodos se dividen correctamente
     for (int z = 0; z < n; z++) {
-        TreeNode* target_leaf = root;
-        const vector<int>& epi = EP[z][0];
+        const uint8_t* epi = EP.row(0, z);
 
         // Navegar al nodo hoja
-        while (!target_leaf->is_leaf()) {
-            if (epi[0] & (1 << 0)) {
-                target_leaf = target_leaf->right;
-            } else {
-                target_leaf = target_leaf->left;
-            }
-        }
+        TreeNode* target_leaf = find_leaf(DETs[0], epi);
 
         // Verificar que el punto está en el nodo hoja
         bool found = false;
-        for (const auto& entry : target_leaf->entries) {
-            if (entry.first.coordinates == vector<double>(epi.begin(), epi.end())) {
+        for (uint32_t t = 0; t < target_leaf->count; ++t) {
+            if (target_leaf->ids[t] == static_cast<uint32_t>(z)) {
                 found = true;
                 break;
             }
@@ -139,54 +169,1144 @@ void test_create_index_with_split() {
         assert(found); // Asegurarse de que el punto fue encontrado
     }
 
-    // Verificar divisiones de nodos
-    for (TreeNode* node : DETs) {
+    // Verificar divisiones de nodos: la raíz reparte en 2^K hijos y cada
+    // nodo interno bajo ella tiene ambos hijos
+    vector<TreeNode*> pending(root->children, root->children + root->child_count);
+    while (!pending.empty()) {
+        TreeNode* node = pending.back();
+        pending.pop_back();
         if (!node->is_leaf()) {
             assert(node->left != nullptr);  // Nodo izquierdo existe
             assert(node->right != nullptr); // Nodo derecho existe
+            pending.push_back(node->left);
+            pending.push_back(node->right);
+        }
+    }
+
+    // K fuera de rango se rechaza antes de reservar 2^K hijos
+    for (int bad_K : {0, 31, 40}) {
+        CodeBuffer codes(L, n, max(bad_K, 1));
+        bool rejected = false;
+        try {
+            create_index(bad_K, L, n, codes, Nr, max_size);
+        } catch (const invalid_argument&) {
+            rejected = true;
         }
+        assert(rejected);
     }
 
     cout << "Prueba de create_index con splitNode exitosa" << endl;
 }
 
-vector<Eigen::VectorXd> generate_random_queries(int num_queries, int d) {
-    vector<Eigen::VectorXd> queries(num_queries);
-    random_device rd;
-    mt19937 gen(rd());
-    uniform_real_distribution<> dis(0.0, 100.0);
+// Máxima ocupación de hoja en un subárbol
+size_t max_leaf_size(TreeNode* node) {
+    if (!node) return 0;
+    if (node->is_leaf()) return node->count;
+    size_t size = max(max_leaf_size(node->left), max_leaf_size(node->right));
+    for (uint32_t c = 0; c < node->child_count; ++c) {
+        size = max(size, max_leaf_size(node->children[c]));
+    }
+    return size;
+}
 
-    for (auto& query : queries) {
-        query = Eigen::VectorXd(d);
-        for (int i = 0; i < d; ++i) {
-            query[i] = dis(gen);
+void test_bulk_load_index() {
+    int K = 4;
+    int L = 2;
+    int n = 2000;
+    int Nr = 8;
+    int max_size = 5;
+
+    CodeBuffer EP(L, n, K);
+    mt19937 gen(7);
+    uniform_int_distribution<> dist(0, Nr - 1);
+    for (int i = 0; i < L; i++) {
+        for (int z = 0; z < n; z++) {
+            for (int k = 0; k < K; k++) {
+                EP.at(i, z, k) = dist(gen);
+            }
         }
     }
 
-    return queries;
+    vector<DETree> inserted = create_index(K, L, n, EP, Nr, max_size);
+    vector<DETree> bulk = bulk_load_index(K, L, n, EP, Nr, max_size);
+
+    for (int i = 0; i < L; i++) {
+        assert(count_points(bulk[i].root) == n);
+        assert(count_points(inserted[i].root) == n);
+
+        // Cada punto está en la hoja a la que lo lleva la navegación
+        for (int z = 0; z < n; z++) {
+            const uint8_t* epi = EP.row(i, z);
+            TreeNode* leaf = find_leaf(bulk[i], epi);
+            bool found = find(leaf->ids, leaf->ids + leaf->count, static_cast<uint32_t>(z)) != leaf->ids + leaf->count;
+            assert(found);
+        }
+
+        // Con 2000 puntos y 8^4 combinaciones de códigos los duplicados son raros
+        // pero posibles: una hoja sólo supera max_size si ya no se puede dividir
+        assert(max_leaf_size(bulk[i].root) <= static_cast<size_t>(max_size) ||
+               max_leaf_size(inserted[i].root) > static_cast<size_t>(max_size));
+    }
+
+    // La copia plana encuentra cada punto en la misma hoja que el árbol de punteros
+    // Breakpoints sintéticos: la región r de cada dimensión es [r, r + 1]
+    vector<vector<vector<double>>> B(L, vector<vector<double>>(K, vector<double>(Nr + 1)));
+    for (int i = 0; i < L; i++) {
+        for (int k = 0; k < K; k++) {
+            for (int r = 0; r <= Nr; r++) {
+                B[i][k][r] = r;
+            }
+        }
+    }
+    PackedCodes packed = PackedCodes::pack(EP, Nr);
+    vector<FlatDETree> flat = flatten_index(bulk, packed, B);
+    for (int i = 0; i < L; i++) {
+        assert(flat[i].size() == static_cast<size_t>(n));
+        for (int z = 0; z < n; z++) {
+            const FlatNode& leaf = flat[i].node(flat[i].find_leaf(EP.row(i, z)));
+            const uint32_t* ids = flat[i].leaf_ids(leaf);
+            assert(leaf.count == find_leaf(bulk[i], EP.row(i, z))->count);
+            assert(find(ids, ids + leaf.count, static_cast<uint32_t>(z)) != ids + leaf.count);
+        }
+
+        // Con un radio que cubre todo el espacio se recuperan todos
+        vector<uint32_t> S;
+        flat_range_query(flat[i], vector<double>(K, 0.0).data(), Nr * K, S);
+        assert(S.size() == static_cast<size_t>(n));
+    }
+
+    // La poda por cajas no pierde puntos: el resultado es exactamente el de
+    // revisar la región de cada punto, y se visita una parte de las hojas
+    RegionBounds bounds(B[0]);
+    vector<double> q_prime = {3.5, 3.5, 3.5, 3.5};
+    double r_prime = 1.5;
+    vector<uint32_t> expected;
+    for (int z = 0; z < n; z++) {
+        const uint8_t* epi = EP.row(0, z);
+        if (bounds.lower_bound2(q_prime.data(), epi, epi) <= r_prime * r_prime) {
+            expected.push_back(z);
+        }
+    }
+    vector<uint32_t> S;
+    size_t visited = flat_range_query(flat[0], q_prime.data(), r_prime, S);
+    sort(S.begin(), S.end());
+    assert(S == expected);
+
+    vector<uint32_t> from_pointers;
+    for (const auto& entry : det_range_query(bulk[0].root, CodeView(EP, 0), bounds, q_prime, r_prime, K)) {
+        from_pointers.push_back(entry.second);
+    }
+    sort(from_pointers.begin(), from_pointers.end());
+    assert(from_pointers == expected);
+
+    // Las cajas que mantienen insert_point y splitNode podan igual de bien
+    vector<uint32_t> from_inserts;
+    flat_range_query(flatten_index(inserted, packed, B)[0], q_prime.data(), r_prime, from_inserts);
+    sort(from_inserts.begin(), from_inserts.end());
+    assert(from_inserts == expected);
+
+    size_t leaves = 0;
+    for (uint32_t idx = 0; idx < flat[0].node_count(); idx++) {
+        leaves += flat[0].node(idx).is_leaf() && flat[0].node(idx).count > 0;
+    }
+    cout << "Range query: " << S.size() << " points, " << visited << " of "
+         << leaves << " leaves visited" << endl;
+    assert(visited < leaves);
+
+    // Radio creciente con RangeCursor: en cada paso lo acumulado es el
+    // resultado de la consulta completa, sin repetir ids, y en total se
+    // abren como mucho las hojas de un recorrido con el radio final
+    RangeCursor cursor(flat[0], q_prime.data());
+    vector<uint32_t> grown;
+    size_t cursor_leaves = 0;
+    size_t restart_leaves = 0;
+    size_t final_leaves = 0;
+    for (double radius = 0.1; radius < 4.0; radius *= 1.4) {
+        cursor_leaves += cursor.expand(radius, grown);
+        vector<uint32_t> full;
+        final_leaves = flat_range_query(flat[0], q_prime.data(), radius, full);
+        restart_leaves += final_leaves;
+        vector<uint32_t> sorted_grown = grown;
+        sort(sorted_grown.begin(), sorted_grown.end());
+        sort(full.begin(), full.end());
+        assert(sorted_grown == full);
+        assert(cursor.next_lower2() > radius * radius);
+    }
+    cout << "Radius expansion: " << cursor_leaves << " leaves with RangeCursor, "
+         << restart_leaves << " restarting, " << final_leaves << " at the final radius" << endl;
+    assert(cursor_leaves <= final_leaves);
+
+    // Un cursor reiniciado sobre otro árbol y otra consulta entrega lo
+    // mismo que uno nuevo
+    vector<double> other_q = {1.0, 6.5, 2.0, 4.0};
+    RangeCursor fresh_cursor(flat[1], other_q.data());
+    cursor.reset(flat[1], other_q.data());
+    for (double radius = 0.5; radius < 4.0; radius *= 2.0) {
+        vector<uint32_t> from_reset;
+        vector<uint32_t> from_fresh;
+        assert(cursor.expand(radius, from_reset) == fresh_cursor.expand(radius, from_fresh));
+        assert(from_reset == from_fresh);
+        assert(cursor.next_lower2() == fresh_cursor.next_lower2());
+    }
+
+    // El árbol cargado en bloque admite inserciones posteriores
+    insert_point(bulk[0], CodeView(packed, 0), 0, max_size);
+    assert(count_points(bulk[0].root) == n + 1);
+
+    // Toda la memoria de un árbol sale de su arena y se libera de una vez
+    assert(bulk[0].bytes() > 0);
+    size_t before = index_bytes(bulk);
+    bulk[0].release();
+    assert(bulk[0].bytes() == 0);
+    assert(index_bytes(bulk) < before);
+
+    cout << "Prueba de bulk_load_index exitosa" << endl;
+}
+
+// Mayor distancia² en el espacio i entre q' y la proyección de algún punto
+// del subárbol de idx
+double max_projected_distance2(const FlatDETree& tree, uint32_t idx, const ProjectionBuffer& P, int i, const double* q) {
+    const FlatNode& node = tree.node(idx);
+    if (!node.is_leaf()) {
+        return max(max_projected_distance2(tree, node.first, P, i, q),
+                   max_projected_distance2(tree, node.first + 1, P, i, q));
+    }
+    double far = 0.0;
+    const uint32_t* ids = tree.leaf_ids(node);
+    for (uint32_t t = 0; t < node.count; ++t) {
+        double sum = 0.0;
+        for (int j = 0; j < tree.dims(); ++j) {
+            double diff = P.at(i, ids[t], j) - q[j];
+            sum += diff * diff;
+        }
+        far = max(far, sum);
+    }
+    return far;
+}
+
+void test_region_bounds() {
+    int K = 4;
+    int L = 2;
+    int n = 1000;
+    int d = 16;
+    int Nr = 4;
+
+    mt19937 gen(3);
+    DatasetStore data = random_dataset(n, d, gen, uniform_real_distribution<>(0.0, 100.0));
+    DatasetView dataset = data.view();
+
+    // Con una muestra chica muchos puntos quedan fuera de [B_0, B_Nr] y
+    // caen en las regiones de los extremos
+    LSH lsh(K, L, d, 5.0, 7);
+    ProjectionBuffer P = lsh.project_dataset(dataset);
+    auto B = breakpoints_selection(K, L, n, P, 20, Nr);
+    CodeBuffer EP = encode_with_breakpoints(K, L, n, P, B, Nr);
+    vector<DETree> DETs = create_index(K, L, n, EP, Nr, 10);
+    vector<FlatDETree> flat = flatten_index(DETs, PackedCodes::pack(EP, Nr), B);
+
+    size_t outside = 0;
+    for (int i = 0; i < L; i++) {
+        for (int z = 0; z < n; z++) {
+            for (int j = 0; j < K; j++) {
+                outside += P.at(i, z, j) < B[i][j][0] || P.at(i, z, j) > B[i][j][Nr];
+            }
+        }
+    }
+    assert(outside > 0);
+
+    // Consultas justo sobre cada borde de región (incluidos B_0 y B_Nr): la
+    // cota superior de cada caja no queda por debajo de ningún punto suyo
+    for (int i = 0; i < L; i++) {
+        const RegionBounds& bounds = flat[i].bounds();
+        for (int r = 0; r <= Nr; r++) {
+            vector<double> q_prime(K);
+            for (int j = 0; j < K; j++) {
+                q_prime[j] = B[i][j][r];
+            }
+            const QueryBounds tables(bounds, q_prime.data());
+            for (uint32_t idx = 0; idx < flat[i].node_count(); idx++) {
+                const uint8_t* box = flat[i].box(idx);
+                if (box[0] > box[K]) {
+                    continue;  // Caja vacía
+                }
+                double far = max_projected_distance2(flat[i], idx, P, i, q_prime.data());
+                assert(bounds.upper_bound2(q_prime.data(), box, box + K) >= far);
+                assert(tables.upper2(box, box + K) >= far);
+                assert(tables.upper2(box, box + K) == bounds.upper_bound2(q_prime.data(), box, box + K));
+            }
+        }
+    }
+
+    cout << "Prueba de cotas de regiones exitosa (" << outside << " proyecciones fuera de la muestra)" << endl;
+}
+
+void test_queries() {
+    int K = 8;
+    int L = 3;
+    int n = 500;
+    int d = 24;
+    int Nr = 8;
+
+    mt19937 gen(11);
+    DatasetStore data = random_dataset(n, d, gen, uniform_real_distribution<>(0.0, 100.0));
+    DatasetView dataset = data.view();
+
+    LSH lsh(K, L, d, 5.0, 42);
+    ProjectionBuffer P = lsh.project_dataset(dataset);
+    auto B = breakpoints_selection(K, L, n, P, 50, Nr);
+    CodeBuffer EP = encode_with_breakpoints(K, L, n, P, B, Nr);
+    vector<DETree> DETs = create_index(K, L, n, EP, Nr, 10);
+    vector<FlatDETree> flat = flatten_index(DETs, PackedCodes::pack(EP, Nr), B);
+
+    // Un punto del dataset usado como consulta cae en las mismas
+    // proyecciones y regiones con las que se indexó
+    ProjectedQuery projected;
+    for (int z = 0; z < n; z += 37) {
+        project_query(dataset.row(z), lsh, flat, projected);
+        for (int i = 0; i < L; i++) {
+            for (int j = 0; j < K; j++) {
+                assert(projected.q_prime(i)[j] == P.at(i, z, j));
+                assert(projected.code(i)[j] == EP.at(i, z, j));
+            }
+        }
+    }
+
+    // project_point (un espacio, producto matriz-vector) coincide con la
+    // proyección por bloques del dataset en todos los puntos
+    for (int z = 0; z < n; z++) {
+        for (int i = 0; i < L; i++) {
+            vector<double> single = lsh.project_point(dataset.row(z), i);
+            for (int j = 0; j < K; j++) {
+                assert(single[j] == P.at(i, z, j));
+            }
+        }
+    }
+
+    cout << "Prueba de project_query exitosa" << endl;
+
+    // Sin corte por beta (beta·n + k > n), la versión paralela junta el mismo
+    // S que la secuencial en cada radio y devuelve los mismos vecinos
+    ThreadPool pool(4);
+    for (int z = 0; z < n; z += 97) {
+        auto serial = c2_k_ANN_Query(dataset.row(z), dataset, K, L, 2.0, 10.0, 1.2, 2.0, 3, flat, lsh);
+        auto parallel = c2_k_ANN_Query_parallel(dataset.row(z), dataset, K, L, 2.0, 10.0, 1.2, 2.0, 3, flat, lsh, pool);
+        assert(serial.size() == parallel.size());
+        for (size_t t = 0; t < serial.size(); t++) {
+            assert(serial[t].second == parallel[t].second);
+        }
+        assert(parallel[0].second == 0.0);
+
+        // La memoria de trabajo del hilo se reusa: repetir la consulta da lo mismo
+        assert(c2_k_ANN_Query_parallel(dataset.row(z), dataset, K, L, 2.0, 10.0, 1.2, 2.0, 3, flat, lsh, pool) == parallel);
+
+        // Cada árbol encuentra el propio punto, a distancia 0 <= c·r
+        assert(ann_query_parallel(dataset.row(z), dataset, K, L, 2.0, 1.0, 1.2, 2.0, flat, lsh, pool) ==
+               ann_query(dataset.row(z), dataset, K, L, 2.0, 1.0, 1.2, 2.0, flat, lsh));
+        assert(ann_query_parallel(dataset.row(z), dataset, K, L, 2.0, 1.0, 1.2, 2.0, flat, lsh, pool).first == z);
+    }
+
+    // Con beta = 0 el primer árbol que encuentra k candidatos corta a todos
+    auto early = c2_k_ANN_Query_parallel(dataset.row(0), dataset, K, L, 2.0, 10.0, 1.2, 0.0, 3, flat, lsh, pool);
+    assert(early.size() == 3);
+
+    cout << "Prueba de c2_k_ANN_Query_parallel exitosa" << endl;
+
+    // Por lotes: cada columna es la respuesta de la consulta individual
+    DatasetView batch = dataset.slice(0, 150);
+    BatchResult answers = c2_k_ANN_Query_batch(batch, dataset, K, L, 2.0, 10.0, 1.2, 0.1, 3, flat, lsh, pool);
+    assert(answers.nq == batch.size() && answers.k == 3);
+    for (size_t qi = 0; qi < batch.size(); qi++) {
+        auto single = c2_k_ANN_Query(batch.row(qi), dataset, K, L, 2.0, 10.0, 1.2, 0.1, 3, flat, lsh);
+        for (size_t t = 0; t < single.size(); t++) {
+            assert(answers.neighbor_distance(qi, t) == single[t].second);
+        }
+    }
+
+    // K se toma de lsh, igual que en las consultas individuales
+    BatchResult other_K = c2_k_ANN_Query_batch(batch, dataset, K + 3, L, 2.0, 10.0, 1.2, 0.1, 3, flat, lsh, pool);
+    assert(other_K.ids == answers.ids && other_K.distances == answers.distances);
+
+    // Consultas de otra dimensión o k negativo se rechazan antes de reservar
+    auto batch_rejects = [&](const DatasetView& queries, int k) {
+        try {
+            c2_k_ANN_Query_batch(queries, dataset, K, L, 2.0, 10.0, 1.2, 0.1, k, flat, lsh, pool);
+        } catch (const invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    DatasetStore wide(4, d + 1);
+    assert(batch_rejects(wide.view(), 3));
+    assert(batch_rejects(batch, -1));
+
+    cout << "Prueba de c2_k_ANN_Query_batch exitosa" << endl;
+
+    // Best-first: con un epsilon enorme nunca se confirma antes de tiempo,
+    // así que se miden todos los puntos y el resultado es el k-NN exacto
+    vector<uint32_t> all_ids(n);
+    for (int z = 0; z < n; z++) {
+        all_ids[z] = z;
+    }
+    for (int z = 0; z < n; z += 131) {
+        auto exact = rerank(dataset.row(z), dataset, all_ids.data(), n, 5);
+        QueryResult exhaustive = best_first_knn(dataset.row(z), dataset, L, 1e9, 5, QueryBudget(), flat, lsh);
+        assert(exhaustive.neighbors == exact);
+        assert(exhaustive.stop == StopReason::Exhausted && exhaustive.distances == static_cast<size_t>(n));
+
+        // Con el epsilon de las consultas el vecino más cercano (el propio punto) sigue primero
+        QueryResult confirmed = best_first_knn(dataset.row(z), dataset, L, 1.2, 5, QueryBudget(), flat, lsh);
+        assert(confirmed.neighbors.size() == 5 && confirmed.neighbors[0].first == z);
+
+        // El presupuesto de candidatos corta la búsqueda y devuelve lo mejor hasta ahí
+        QueryBudget budget;
+        budget.max_candidates = 20;
+        QueryResult budgeted = best_first_knn(dataset.row(z), dataset, L, 1e9, 5, budget, flat, lsh);
+        assert(budgeted.stop == StopReason::Candidates && budgeted.candidates == 20);
+        assert(budgeted.neighbors.size() == 5 && budgeted.neighbors[0].first == z);
+
+        // Con k = 0 (o negativo) no hay nada que buscar
+        for (int empty_k : {0, -1}) {
+            QueryResult none = best_first_knn(dataset.row(z), dataset, L, 1.2, empty_k, QueryBudget(), flat, lsh);
+            assert(none.neighbors.empty() && none.stop == StopReason::Completed);
+            assert(none.candidates == 0 && none.leaves == 0 && none.distances == 0);
+        }
+    }
+
+    cout << "Prueba de best_first_knn exitosa" << endl;
+
+    // Límites de c²-k-ANN: con beta que nunca se cumple y un radio que no
+    // alcanza, cada límite corta la consulta y devuelve lo mejor hasta ahí
+    const float* outlier = dataset.row(3);
+    QueryResult unlimited = c2_k_ANN_Query(outlier, dataset, K, L, 1.1, 0.01, 1.2, 2.0, 5, flat, lsh, QueryBudget());
+    assert(unlimited.neighbors == c2_k_ANN_Query(outlier, dataset, K, L, 1.1, 0.01, 1.2, 2.0, 5, flat, lsh));
+    assert(unlimited.stop == StopReason::Completed || unlimited.stop == StopReason::Exhausted);
+
+    QueryBudget limits[4];
+    limits[0].max_candidates = 7;
+    limits[1].max_leaves = 3;
+    limits[2].max_distances = 9;
+    limits[3].deadline = chrono::microseconds(1);
+    StopReason reasons[4] = {StopReason::Candidates, StopReason::Leaves, StopReason::Distances, StopReason::Deadline};
+    for (int t = 0; t < 4; t++) {
+        QueryResult limited = c2_k_ANN_Query(outlier, dataset, K, L, 1.1, 0.01, 1.2, 2.0, 5, flat, lsh, limits[t]);
+        assert(limited.stop == reasons[t]);
+        assert(limited.leaves <= unlimited.leaves && limited.distances <= unlimited.distances);
+        assert(limited.neighbors.empty() || limited.neighbors[0].first == 3);
+    }
+    QueryResult few = c2_k_ANN_Query(outlier, dataset, K, L, 1.1, 0.01, 1.2, 2.0, 5, flat, lsh, limits[0]);
+    assert(few.candidates == 7 && few.distances == 7);
+
+    // Sin k candidatos en todo el índice la consulta termina igual
+    QueryResult everything = c2_k_ANN_Query(outlier, dataset, K, L, 2.0, 0.01, 1.2, 2.0, n + 1, flat, lsh, QueryBudget());
+    assert(everything.stop == StopReason::Exhausted && everything.neighbors.size() == static_cast<size_t>(n));
+
+    cout << "Prueba de QueryBudget exitosa" << endl;
+
+    // Índice guardado y abierto con mmap: los árboles son vistas sobre el
+    // archivo y las consultas dan exactamente lo mismo
+    const string index_path = "test_index.deti";
+    save_index(index_path, lsh, flat);
+    {
+        MappedIndex mapped(index_path);
+        assert(mapped.trees().size() == flat.size() && mapped.size() == static_cast<size_t>(n));
+        mapped.check_dataset(dataset);
+        bool wrong_dataset = false;
+        try {
+            mapped.check_dataset(dataset.slice(0, n - 1));
+        } catch (const runtime_error&) {
+            wrong_dataset = true;
+        }
+        assert(wrong_dataset);
+        for (int i = 0; i < L; i++) {
+            assert(mapped.trees()[i].node_count() == flat[i].node_count());
+            assert(mapped.trees()[i].size() == flat[i].size());
+        }
+        for (int z = 0; z < n; z += 53) {
+            assert(c2_k_ANN_Query(dataset.row(z), dataset, K, L, 1.5, 1.0, 1.2, 0.1, 5, mapped.trees(), mapped.lsh()) ==
+                   c2_k_ANN_Query(dataset.row(z), dataset, K, L, 1.5, 1.0, 1.2, 0.1, 5, flat, lsh));
+        }
+    }
+
+    // Un byte cambiado en los datos lo detecta el checksum; en la cabecera,
+    // aunque no se pida verificar los datos
+    auto corrupt_and_open = [&](size_t offset, bool verify) {
+        save_index(index_path, lsh, flat);
+        fstream file(index_path, ios::in | ios::out | ios::binary);
+        file.seekg(offset);
+        char byte = 0;
+        file.read(&byte, 1);
+        byte ^= 0x10;
+        file.seekp(offset);
+        file.write(&byte, 1);
+        file.close();
+        try {
+            MappedIndex mapped(index_path, verify);
+        } catch (const runtime_error&) {
+            return false;
+        }
+        return true;
+    };
+    const size_t last_byte = MappedFile(index_path).size() - 1;
+    assert(!corrupt_and_open(last_byte / 2, true));
+    assert(!corrupt_and_open(20, false));
+
+    // Por defecto el checksum de los datos no se recorre al abrir; se puede
+    // pedir después
+    assert(corrupt_and_open(last_byte / 2, false));
+    assert(!MappedIndex(index_path).verify());
+    save_index(index_path, lsh, flat);
+    assert(MappedIndex(index_path).verify());
+
+    // Una cabecera con su checksum bien calculado pero con parámetros
+    // imposibles (o una tabla de árboles fuera del archivo) se rechaza
+    // aunque no se verifiquen los datos
+    auto rewrite_and_open = [&](auto edit) {
+        save_index(index_path, lsh, flat);
+        fstream file(index_path, ios::in | ios::out | ios::binary);
+        IndexHeader header;
+        IndexTreeEntry entry;
+        file.read(reinterpret_cast<char*>(&header), sizeof(IndexHeader));
+        file.read(reinterpret_cast<char*>(&entry), sizeof(IndexTreeEntry));
+        edit(header, entry);
+        header.header_checksum = 0;
+        header.header_checksum = index_checksum(reinterpret_cast<const unsigned char*>(&header), sizeof(IndexHeader));
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(IndexTreeEntry));
+        file.close();
+        try {
+            MappedIndex mapped(index_path);
+        } catch (const runtime_error&) {
+            return false;
+        }
+        return true;
+    };
+    assert(rewrite_and_open([](IndexHeader&, IndexTreeEntry&) {}));
+    assert(!rewrite_and_open([](IndexHeader& h, IndexTreeEntry&) { h.lane_bits = 0; }));
+    assert(!rewrite_and_open([](IndexHeader& h, IndexTreeEntry&) { h.Nr = 0; }));
+    assert(!rewrite_and_open([](IndexHeader& h, IndexTreeEntry&) { h.K = 40; }));
+    assert(!rewrite_and_open([](IndexHeader& h, IndexTreeEntry&) { h.words += 1; }));
+    assert(!rewrite_and_open([](IndexHeader& h, IndexTreeEntry&) { h.L = 1 << 30; }));
+    assert(!rewrite_and_open([](IndexHeader&, IndexTreeEntry& e) { e.node_count = uint64_t(1) << 62; }));
+    assert(!rewrite_and_open([](IndexHeader&, IndexTreeEntry& e) { e.ids_offset += 64 * 1024 * 1024; }));
+    assert(!rewrite_and_open([](IndexHeader& h, IndexTreeEntry&) { h.n += 1; }));
+
+    // Cambia los datos en `offset` y vuelve a calcular los dos checksums,
+    // como haría un archivo armado a mano: solo quedan las revisiones de
+    // estructura y de ids
+    auto resign = [&](size_t offset, const void* data, size_t length) {
+        save_index(index_path, lsh, flat);
+        fstream file(index_path, ios::in | ios::out | ios::binary);
+        file.seekp(offset);
+        file.write(static_cast<const char*>(data), length);
+        file.close();
+        MappedFile mapped(index_path);
+        IndexHeader header = *reinterpret_cast<const IndexHeader*>(mapped.data());
+        header.payload_checksum = index_checksum(mapped.data() + sizeof(IndexHeader), mapped.size() - sizeof(IndexHeader));
+        header.header_checksum = 0;
+        header.header_checksum = index_checksum(reinterpret_cast<const unsigned char*>(&header), sizeof(IndexHeader));
+        fstream out(index_path, ios::in | ios::out | ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+    };
+    auto opens = [&](bool verify) {
+        try {
+            MappedIndex mapped(index_path, verify);
+        } catch (const runtime_error&) {
+            return false;
+        }
+        return true;
+    };
+    IndexTreeEntry entry;
+    {
+        ifstream in(index_path, ios::binary);
+        in.seekg(sizeof(IndexHeader));
+        in.read(reinterpret_cast<char*>(&entry), sizeof(IndexTreeEntry));
+    }
+
+    // Un nodo que apunta fuera del árbol se rechaza siempre
+    const uint32_t far = 0xFFFFFFF0u;
+    resign(entry.nodes_offset, &far, sizeof(uint32_t));
+    assert(!opens(false));
+
+    // Un id >= n pasa la apertura rápida, pero no verify()
+    const uint32_t bad_id = n;
+    resign(entry.ids_offset, &bad_id, sizeof(uint32_t));
+    assert(opens(false) && !MappedIndex(index_path).verify());
+    assert(!opens(true));
+    std::remove(index_path.c_str());
+
+    cout << "Prueba de save_index/MappedIndex exitosa" << endl;
+}
+
+void test_lsh_state() {
+    int K = 6;
+    int L = 3;
+    int d = 20;
+    double w = 4.0;
+
+    mt19937 gen(13);
+    DatasetStore data = random_dataset(50, d, gen, uniform_real_distribution<>(-10.0, 10.0));
+    DatasetView dataset = data.view();
+
+    // Proyecciones de todo el dataset con las funciones hash de lsh
+    auto projections = [&](const LSH& lsh) {
+        vector<float> out(size_t(50) * L * K);
+        for (int z = 0; z < 50; z++) {
+            lsh.project_query(dataset.row(z), &out[size_t(z) * L * K]);
+        }
+        return out;
+    };
+
+    // La misma semilla da las mismas funciones hash, aunque se generen con
+    // otra cantidad de hilos; otra semilla da otras
+    ThreadPool one(1);
+    LSH a(K, L, d, w, 1234);
+    LSH b(K, L, d, w, 1234);
+    LSH c(K, L, d, w, 1235);
+    assert(projections(a) == projections(b));
+    assert(projections(a) != projections(c));
+    assert(a.generate_hash_functions(one) == b.generate_hash_functions());
+
+    // Guardar y cargar conserva los parámetros y las proyecciones exactas
+    const string path = "test_lsh_state.bin";
+    a.save(path);
+    LSH loaded = LSH::load(path);
+    assert(loaded.get_K() == K && loaded.get_L() == L && loaded.get_d() == d);
+    assert(loaded.get_w() == w && loaded.get_seed() == 1234);
+    assert(projections(loaded) == projections(a));
+
+    // Un archivo que no es de LSH, o cortado, se rechaza
+    auto rejects = [&](size_t keep) {
+        {
+            ifstream in(path, ios::binary);
+            string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            ofstream out(path, ios::binary | ios::trunc);
+            out.write(bytes.data(), min(keep, bytes.size()));
+        }
+        try {
+            LSH::load(path);
+        } catch (const runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    assert(rejects(200));
+    assert(rejects(3));
+    std::remove(path.c_str());
+
+    cout << "Prueba de LSH save/load y semillas exitosa" << endl;
+}
+
+void test_encode_kernel() {
+    mt19937 gen(17);
+
+    for (int Nr : {1, 2, 3, 8, 16, 255, 256}) {
+        // Breakpoints enteros (con repetidos) como los de una muestra proyectada
+        uniform_int_distribution<> edge(-40, 40);
+        vector<double> B(Nr + 1);
+        for (int r = 0; r <= Nr; r++) {
+            B[r] = edge(gen);
+        }
+        sort(B.begin(), B.end());
+
+        // Todas las colas de los kernels (16, 8 y escalar) y salida con paso K
+        for (size_t n : {1, 7, 8, 15, 16, 17, 33, 100}) {
+            for (size_t stride : {1, 3, 16}) {
+                // Valores enteros: la mitad exactamente sobre un breakpoint y
+                // algunos fuera de [B[0], B[Nr]]
+                vector<float> values(n);
+                uniform_int_distribution<> pick(0, Nr);
+                uniform_int_distribution<> value(-60, 60);
+                for (size_t t = 0; t < n; t++) {
+                    values[t] = t % 2 == 0 ? B[pick(gen)] : value(gen);
+                }
+
+                vector<uint8_t> simd(n * stride, 0xAA);
+                vector<uint8_t> scalar(n * stride, 0xAA);
+                encode_regions(values.data(), n, B.data(), Nr, simd.data(), stride);
+                encode_regions_scalar(values.data(), n, B.data(), Nr, scalar.data(), stride);
+                assert(simd == scalar);
+
+                // Región = breakpoints internos B[1..Nr-1] <= valor
+                for (size_t t = 0; t < n; t++) {
+                    int expected = upper_bound(B.begin() + 1, B.begin() + Nr, static_cast<double>(values[t])) - (B.begin() + 1);
+                    assert(simd[t * stride] == expected);
+                }
+            }
+        }
+    }
+
+    cout << "Prueba de encode_regions (" << encode_kernel_name() << ") exitosa" << endl;
+}
+
+void test_packed_codes() {
+    mt19937 gen(23);
+
+    // Carriles de 4 bits (Nr = 16) y de 8 bits (Nr = 200), con K que no
+    // llena la última palabra
+    for (int Nr : {16, 200}) {
+        for (size_t K : {3, 16, 17, 21}) {
+            const size_t n = 300;
+            // Pocos valores por coordenada para que haya iguales y cajas que contienen
+            uniform_int_distribution<> narrow(0, 2);
+            uniform_int_distribution<> offset(0, Nr - 3);
+            vector<int> base(K);
+            for (size_t j = 0; j < K; j++) {
+                base[j] = offset(gen);
+            }
+            CodeBuffer codes(1, n, K);
+            for (size_t z = 0; z < n; z++) {
+                for (size_t j = 0; j < K; j++) {
+                    codes.at(0, z, j) = base[j] + narrow(gen);
+                }
+            }
+            PackedCodes packed = PackedCodes::pack(codes, Nr);
+            const size_t words = packed.words_per_row();
+            const int bits = packed.bits();
+            assert(bits == (Nr <= 16 ? 4 : 8));
+
+            for (size_t a = 0; a < n; a++) {
+                const size_t b = (a * 7 + 1) % n;
+                const size_t c = (a * 13 + 5) % n;
+                const uint8_t* ca = codes.row(0, a);
+                const uint8_t* cb = codes.row(0, b);
+                const uint8_t* cc = codes.row(0, c);
+
+                // Igualdad y coordenadas iguales, contra los bytes sueltos
+                int matching = 0;
+                for (size_t j = 0; j < K; j++) {
+                    matching += ca[j] == cb[j];
+                }
+                assert(packed_equal(packed.row(0, a), packed.row(0, b), words) == (matching == static_cast<int>(K)));
+                assert(packed_equal(packed.row(0, a), packed.row(0, a), words));
+                assert(packed_matching_lanes(packed.row(0, a), packed.row(0, b), words, bits, K) == matching);
+
+                // Caja con los mínimos y máximos de b y c en cada coordenada
+                vector<uint8_t> lo(K), hi(K);
+                bool inside = true;
+                for (size_t j = 0; j < K; j++) {
+                    lo[j] = min(cb[j], cc[j]);
+                    hi[j] = max(cb[j], cc[j]);
+                    inside = inside && lo[j] <= ca[j] && ca[j] <= hi[j];
+                }
+                PackedCodes box(1, 2, K, Nr);
+                box.pack_row(0, 0, lo.data());
+                box.pack_row(0, 1, hi.data());
+                assert(packed_in_box(packed.row(0, a), box.row(0, 0), box.row(0, 1), words, bits) == inside);
+                assert(packed_in_box(packed.row(0, b), box.row(0, 0), box.row(0, 1), words, bits));
+            }
+        }
+    }
+
+    cout << "Prueba de comparaciones empaquetadas exitosa" << endl;
+}
+
+// Escribe filas [int32 d][d elementos] como en .fvecs/.ivecs/.bvecs; la
+// cabecera de la fila `bad_row` lleva d + 1
+template <typename T>
+void write_vecs(const string& path, const vector<vector<T>>& rows, size_t bad_row = SIZE_MAX) {
+    ofstream out(path, ios::binary | ios::trunc);
+    for (size_t i = 0; i < rows.size(); i++) {
+        int32_t d = static_cast<int32_t>(rows[i].size()) + (i == bad_row ? 1 : 0);
+        out.write(reinterpret_cast<const char*>(&d), sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(rows[i].data()), rows[i].size() * sizeof(T));
+    }
 }
 
-std::vector<Point> convertEigenToPoints(const std::vector<Eigen::VectorXd>& eigenVectors) {
-    std::vector<Point> points;
-    points.reserve(eigenVectors.size()); // Reservar memoria para optimización
+template <typename T>
+vector<vector<T>> random_rows(size_t n, size_t d, mt19937& gen) {
+    uniform_int_distribution<> dist(0, 255);
+    vector<vector<T>> rows(n, vector<T>(d));
+    for (auto& row : rows) {
+        for (auto& value : row) {
+            value = static_cast<T>(dist(gen));
+        }
+    }
+    return rows;
+}
+
+// Si abrir `path` lanza runtime_error
+bool open_fails(const string& path, bool verify_headers) {
+    try {
+        MappedVecs file(path, verify_headers);
+    } catch (const runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void test_mapped_vecs() {
+    mt19937 gen(29);
+    const size_t n = 40;
+    const size_t d = 13;
+
+    // Cada formato se expone en su lugar, con las filas tal cual
+    auto floats = random_rows<float>(n, d, gen);
+    auto ints = random_rows<int32_t>(n, d, gen);
+    auto bytes = random_rows<uint8_t>(n, d, gen);
+    write_vecs("test_vecs.fvecs", floats);
+    write_vecs("test_vecs.ivecs", ints);
+    write_vecs("test_vecs.bvecs", bytes);
+    {
+        MappedVecs fv("test_vecs.fvecs");
+        MappedVecs iv("test_vecs.ivecs");
+        MappedVecs bv("test_vecs.bvecs");
+        assert(fv.format() == VecsFormat::FVECS && iv.format() == VecsFormat::IVECS && bv.format() == VecsFormat::BVECS);
+        DatasetView fview = fv.fvecs();
+        IvecsView iview = iv.ivecs();
+        BvecsView bview = bv.bvecs();
+        assert(fview.size() == n && iview.size() == n && bview.size() == n);
+        assert(fview.dim() == d && iview.dim() == d && bview.dim() == d);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < d; j++) {
+                assert(fview.row(i)[j] == floats[i][j]);
+                assert(iview.row(i)[j] == ints[i][j]);
+                assert(bview.row(i)[j] == bytes[i][j]);
+            }
+        }
+
+        // bvecs a float32 alineado
+        DatasetStore converted = to_dataset_store(bview);
+        assert(converted.row(n - 1)[d - 1] == static_cast<float>(bytes[n - 1][d - 1]));
+
+        // Pedir la vista de otro formato es un error de uso
+        bool wrong_view = false;
+        try {
+            bv.ivecs();
+        } catch (const logic_error&) {
+            wrong_view = true;
+        }
+        assert(wrong_view);
+    }
 
-    for (const auto& eigenVec : eigenVectors) {
-        points.emplace_back(eigenVec); // Usar el constructor de Point
+    // Una cabecera rota en el medio solo la ve la revisión completa; en la
+    // primera o la última fila, o con el archivo cortado, falla siempre
+    write_vecs("test_vecs.bvecs", bytes, n / 2);
+    assert(!open_fails("test_vecs.bvecs", false));
+    assert(open_fails("test_vecs.bvecs", true));
+    write_vecs("test_vecs.ivecs", ints, n - 1);
+    assert(open_fails("test_vecs.ivecs", false));
+    write_vecs("test_vecs.fvecs", floats, 0);
+    assert(open_fails("test_vecs.fvecs", false));
+    {
+        write_vecs("test_vecs.fvecs", floats);
+        ofstream extra("test_vecs.fvecs", ios::binary | ios::app);
+        extra.put(0);
     }
+    assert(open_fails("test_vecs.fvecs", false));
+
+    std::remove("test_vecs.fvecs");
+    std::remove("test_vecs.ivecs");
+    std::remove("test_vecs.bvecs");
+
+    cout << "Prueba de MappedVecs exitosa" << endl;
+}
 
-    return points;
+// Fracción de `sorted` que es <= value
+double rank_of(const vector<float>& sorted, float value) {
+    return double(upper_bound(sorted.begin(), sorted.end(), value) - sorted.begin()) / sorted.size();
+}
+
+void test_quantile_sketch() {
+    const size_t n = 150000;
+    mt19937 gen(31);
+    // Valores enteros con repetidos, como las proyecciones con floor
+    normal_distribution<> dist(0.0, 400.0);
+    vector<float> values(n);
+    for (float& v : values) {
+        v = floor(dist(gen));
+    }
+    vector<float> sorted = values;
+    sort(sorted.begin(), sorted.end());
+
+    // Error de rango de un sketch y de cuatro combinados con merge
+    const double tolerance = 0.02;
+    KLLSketch whole(200);
+    vector<KLLSketch> parts;
+    for (int p = 0; p < 4; p++) {
+        parts.emplace_back(200, p + 1);
+    }
+    for (size_t t = 0; t < n; t++) {
+        whole.update(values[t]);
+        parts[t * 4 / n].update(values[t]);
+    }
+    KLLSketch merged(200);
+    for (const KLLSketch& part : parts) {
+        merged.merge(part);
+    }
+    for (const KLLSketch* sketch : {&whole, &merged}) {
+        assert(sketch->count() == n);
+        assert(sketch->min() == sorted.front() && sketch->max() == sorted.back());
+        assert(sketch->retained() < n / 50);
+        for (double q = 0.05; q < 1.0; q += 0.05) {
+            assert(fabs(rank_of(sorted, sketch->quantile(q)) - q) <= tolerance);
+        }
+    }
+
+    // Breakpoints con sketches: extremos exactos, cortes ordenados cerca
+    // de z / Nr, y el mismo resultado con cualquier cantidad de hilos
+    // (n > 65536: varios bloques combinados)
+    int K = 2;
+    int L = 2;
+    int Nr = 8;
+    ProjectionBuffer P(L, K, n);
+    vector<vector<float>> columns;
+    for (int i = 0; i < L; i++) {
+        for (int j = 0; j < K; j++) {
+            vector<float> column(n);
+            for (size_t t = 0; t < n; t++) {
+                column[t] = P.column(i, j)[t] = floor(dist(gen)) + 1000 * (i * K + j);
+            }
+            sort(column.begin(), column.end());
+            columns.push_back(column);
+        }
+    }
+    ThreadPool one(1);
+    ThreadPool four(4);
+    auto B = breakpoints_selection_sketch(K, L, n, P, Nr, 200, one);
+    assert(B == breakpoints_selection_sketch(K, L, n, P, Nr, 200, four));
+    for (int i = 0; i < L; i++) {
+        for (int j = 0; j < K; j++) {
+            const vector<float>& column = columns[i * K + j];
+            assert(B[i][j][0] == column.front() && B[i][j][Nr] == column.back());
+            for (int z = 1; z < Nr; z++) {
+                assert(B[i][j][z - 1] <= B[i][j][z]);
+                assert(fabs(rank_of(column, B[i][j][z]) - double(z) / Nr) <= tolerance);
+            }
+        }
+    }
+
+    cout << "Prueba de KLLSketch y breakpoints_selection_sketch exitosa" << endl;
+}
+
+void test_streaming_build() {
+    int K = 4;
+    int L = 3;
+    int Nr = 8;
+    int max_size = 10;
+    const size_t n = 1000;
+    const size_t d = 12;
+    const size_t chunk_rows = 150;  // No divide a n: el último bloque es más corto
+
+    mt19937 gen(37);
+    auto floats = random_rows<float>(n, d, gen);
+    auto bytes = random_rows<uint8_t>(n, d, gen);
+    const vector<string> paths = {"test_stream.fvecs", "test_stream.bvecs"};
+    write_vecs(paths[0], floats);
+    write_vecs(paths[1], bytes);
+
+    // Cada bloque llega en orden con su primera fila y las filas tal cual;
+    // las de bvecs, convertidas a float
+    for (const string& path : paths) {
+        const bool bvecs = path == paths[1];
+        ChunkReader reader(path, chunk_rows, 2);
+        assert(reader.size() == n && reader.dim() == d);
+        DatasetStore chunk;
+        size_t first_row = 0;
+        size_t expected_first = 0;
+        while (reader.next(chunk, first_row)) {
+            assert(first_row == expected_first);
+            assert(chunk.size() == min(chunk_rows, n - first_row) && chunk.dim() == d);
+            for (size_t r = 0; r < chunk.size(); r++) {
+                for (size_t j = 0; j < d; j++) {
+                    float expected = bvecs ? bytes[first_row + r][j] : floats[first_row + r][j];
+                    assert(chunk.row(r)[j] == expected);
+                }
+            }
+            expected_first += chunk.size();
+        }
+        assert(expected_first == n);
+    }
+
+    // El presupuesto cuenta, por fila, los bloques en vuelo y las
+    // proyecciones y códigos del bloque actual
+    StreamingBuildConfig config;
+    config.Nr = Nr;
+    config.max_size = max_size;
+    const size_t row_bytes = DatasetStore(1, d).row_stride() * sizeof(float) * (config.prefetch + 2) +
+                             size_t(L) * K * (sizeof(float) + sizeof(uint8_t));
+    config.memory_budget = chunk_rows * row_bytes;
+    assert(chunk_rows_for_budget(config.memory_budget, d, K, L, config.prefetch) == chunk_rows);
+    StreamingBuildConfig single = config;
+    single.memory_budget = n * row_bytes;
+
+    // Con los breakpoints del streaming, la construcción en memoria da los
+    // mismos códigos y los mismos árboles. En un solo bloque, los
+    // breakpoints son los de breakpoints_selection_sketch
+    LSH lsh(K, L, d, 4.0, 99);
+    for (const string& path : paths) {
+        StreamingIndex streamed = streaming_build_index(path, lsh, K, L, config);
+        assert(streamed.n == n);
+
+        MappedVecs file(path);
+        DatasetStore converted;
+        if (file.format() == VecsFormat::BVECS) {
+            converted = to_dataset_store(file.bvecs());
+        }
+        DatasetView dataset = file.format() == VecsFormat::BVECS ? converted.view() : file.fvecs();
+        ProjectionBuffer P = lsh.project_dataset(dataset);
+        CodeBuffer EP = encode_with_breakpoints(K, L, n, P, streamed.B, Nr);
+        vector<DETree> DETs = create_index(K, L, n, EP, Nr, max_size);
+        PackedCodes packed = PackedCodes::pack(EP, Nr);
+        for (int i = 0; i < L; i++) {
+            for (size_t z = 0; z < n; z++) {
+                assert(equal(packed.row(i, z), packed.row(i, z) + packed.words_per_row(), streamed.codes.row(i, z)));
+            }
+            assert(same_tree(streamed.DETs[i].root, DETs[i].root));
+        }
+
+        StreamingIndex one_chunk = streaming_build_index(path, lsh, K, L, single);
+        assert(one_chunk.B == breakpoints_selection_sketch(K, L, n, P, Nr, single.sketch_k));
+    }
+
+    // Un error del hilo lector llega a quien consume los bloques, después
+    // de los bloques completos anteriores a la fila rota
+    write_vecs(paths[0], floats, n / 2);
+    size_t delivered = 0;
+    bool reader_failed = false;
+    try {
+        ChunkReader reader(paths[0], chunk_rows);
+        DatasetStore chunk;
+        size_t first_row = 0;
+        while (reader.next(chunk, first_row)) {
+            delivered += chunk.size();
+        }
+    } catch (const runtime_error&) {
+        reader_failed = true;
+    }
+    assert(reader_failed && delivered == (n / 2) / chunk_rows * chunk_rows);
+    bool build_failed = false;
+    try {
+        streaming_build_index(paths[0], lsh, K, L, config);
+    } catch (const runtime_error&) {
+        build_failed = true;
+    }
+    assert(build_failed);
+
+    for (const string& path : paths) {
+        std::remove(path.c_str());
+    }
+
+    cout << "Prueba de ChunkReader y streaming_build_index exitosa" << endl;
+}
+
+void test_build_determinism() {
+    int K = 6;
+    int L = 4;
+    int d = 24;
+    int n = 5000;
+    int Nr = 16;
+    int ns = 2000;
+    int max_size = 12;
+
+    mt19937 gen(41);
+    DatasetStore data = random_dataset(n, d, gen, normal_distribution<>(0.0, 20.0));
+
+    // Toda la construcción con un pool de 1 hilo y con uno de 4: las
+    // proyecciones, los breakpoints, los códigos y los árboles no cambian
+    LSH lsh(K, L, d, 4.0, 2024);
+    ThreadPool one(1);
+    ThreadPool four(4);
+    ProjectionBuffer P1 = lsh.project_dataset(data.view(), one);
+    ProjectionBuffer P4 = lsh.project_dataset(data.view(), four);
+    assert(P1 == P4);
+
+    auto B1 = breakpoints_selection(K, L, n, P1, ns, Nr, one);
+    auto B4 = breakpoints_selection(K, L, n, P4, ns, Nr, four);
+    assert(B1 == B4);
+    assert(breakpoints_selection_sketch(K, L, n, P1, Nr, 200, one) ==
+           breakpoints_selection_sketch(K, L, n, P4, Nr, 200, four));
+
+    CodeBuffer EP1 = encode_with_breakpoints(K, L, n, P1, B1, Nr, one);
+    CodeBuffer EP4 = encode_with_breakpoints(K, L, n, P4, B4, Nr, four);
+    assert(EP1 == EP4);
+    assert(dynamic_encoding(K, L, n, P1, ns, Nr, one) == dynamic_encoding(K, L, n, P4, ns, Nr, four));
+
+    vector<DETree> inserted1 = create_index(K, L, n, EP1, Nr, max_size, one);
+    vector<DETree> inserted4 = create_index(K, L, n, EP4, Nr, max_size, four);
+    vector<DETree> bulk1 = bulk_load_index(K, L, n, EP1, Nr, max_size, 1.0, one);
+    vector<DETree> bulk4 = bulk_load_index(K, L, n, EP4, Nr, max_size, 1.0, four);
+    for (int i = 0; i < L; i++) {
+        assert(same_tree(inserted1[i].root, inserted4[i].root));
+        assert(same_tree(bulk1[i].root, bulk4[i].root));
+        assert(count_points(bulk1[i].root) == n);
+    }
+
+    cout << "Prueba de construcción determinista con 1 y 4 hilos exitosa" << endl;
+}
+
+void test_candidate_set() {
+    CandidateSet S;
+    S.reset();
+    assert(S.insert(7) && S.insert(3) && !S.insert(7));
+    assert(S.size() == 2 && S.contains(3) && !S.contains(4));
+
+    // Entre consultas se vacía sin perder los sellos ya reservados
+    S.reset();
+    assert(S.empty() && !S.contains(7));
+    vector<uint32_t> ids = {5, 1, 5, 9, 1};
+    S.insert(ids.begin(), ids.end());
+    assert((S.items() == vector<uint32_t>{5, 1, 9}));
+
+    cout << "Prueba de CandidateSet exitosa" << endl;
+}
+
+void test_rerank() {
+    int n = 300;
+    mt19937 gen(5);
+    uniform_real_distribution<> dis(-1.0, 1.0);
+
+    // Todas las colas posibles de los kernels (16, 8 y escalar)
+    for (int d : {1, 7, 8, 15, 16, 17, 31, 33, 100}) {
+        vector<float> q(d);
+        for (int j = 0; j < d; j++) {
+            q[j] = dis(gen);
+        }
+        DatasetStore data = random_dataset(n, d, gen, dis);
+        DatasetView dataset = data.view();
+        vector<pair<float, uint32_t>> expected;
+        vector<uint32_t> ids;
+        for (int z = 0; z < n; z++) {
+            float simd = squared_l2(q.data(), dataset.row(z), d);
+            float scalar = squared_l2_scalar(q.data(), dataset.row(z), d);
+            assert(fabs(simd - scalar) <= 1e-5f * max(1.0f, scalar));
+            expected.push_back({simd, z});
+            ids.push_back(z);
+        }
+
+        // El top-k es el mismo que ordenar todo, aunque los candidatos lleguen en otro orden
+        sort(expected.begin(), expected.end());
+        shuffle(ids.begin(), ids.end(), gen);
+        auto nearest = rerank(q.data(), dataset, ids.data(), ids.size(), 10);
+        assert(nearest.size() == 10);
+        for (size_t t = 0; t < nearest.size(); t++) {
+            assert(nearest[t].first == static_cast<int>(expected[t].second));
+        }
+        assert(rerank(q.data(), dataset, ids.data(), 4, 10).size() == 4);
+    }
+
+    cout << "Prueba de rerank (" << distance_kernel_name() << ") exitosa" << endl;
+}
+
+DatasetStore generate_random_queries(int num_queries, int d) {
+    random_device rd;
+    mt19937 gen(rd());
+    DatasetStore queries = random_dataset(num_queries, d, gen, uniform_real_distribution<>(0.0, 100.0));
+
+    return queries;
 }
 
 
 
 void test_indexing_with_queries(string dataset_path, string name) {
-    vector<Eigen::VectorXd> dataset = readFVECS(dataset_path);
+    MappedVecs base_file(dataset_path);
+    DatasetView dataset = base_file.fvecs();
 
     int K = 16; // Dimensiones proyectadas
     int L = 4;  // Espacios proyectados
-    int d = dataset[0].size(); // Dimensiones originales
+    int d = dataset.dim(); // Dimensiones originales
     double w = 5.0;
-    LSH lsh(K, L, d, w);
+    LSH lsh(K, L, d, w, DEFAULT_LSH_SEED);
 
     cout << "Dataset " << name << endl;
 
@@ -197,12 +1317,16 @@ void test_indexing_with_queries(string dataset_path, string name) {
     int ns = 20;  // Tamaño de la muestra para breakpoints
     int Nr = 8;   // Número de regiones
     cout << "Optimized Encoding" << endl;
-    auto encodings = dynamic_encoding(K, L, dataset.size(), projected_points, ns, Nr);
+    auto B = breakpoints_selection(K, L, dataset.size(), projected_points, ns, Nr);
+    auto encodings = encode_with_breakpoints(K, L, dataset.size(), projected_points, B, Nr);
 
     // 5. Construcción de índices (DE-Trees)
     int n = dataset.size();
     int max_size = 20;
-    vector<TreeNode*> DETs = create_index(K, L, n, encodings, max_size);
+    vector<DETree> DETs = create_index(K, L, n, encodings, Nr, max_size);
+    vector<FlatDETree> flat = flatten_index(DETs, PackedCodes::pack(encodings, Nr), B);
+    cout << "Flat DE-Trees: " << flat[0].node_count() << " nodes, "
+         << flat[0].bytes() << " bytes per tree" << endl;
 
 
 
@@ -210,24 +1334,22 @@ void test_indexing_with_queries(string dataset_path, string name) {
 
     // 6. Fase de consulta
     int num_queries = 5;       // Número de consultas
-    vector<Eigen::VectorXd> queriess = generate_random_queries(num_queries, d);
+    DatasetStore queries = generate_random_queries(num_queries, d);
     double r_min = 10.0;       // Radio inicial para consultas ANN
     double c = 2.0;            // Escalamiento del radio
     double epsilon = 1.2;      // Factor de escala del radio proyectado
     double beta = 0.1;         // Parámetro beta para falsos positivos
     int k = 3;                 // Número de vecinos cercanos
 
-    auto queries = convertEigenToPoints(queriess);
-
     cout << "Running queries..." << endl;
 
-    for (int i = 0; i < queries.size(); ++i) {
-        cout << "Query " << i + 1 << ": " << queries[i] << endl;
+    for (int i = 0; i < num_queries; ++i) {
+        cout << "Query " << i + 1 << endl;
 
 
         auto start = chrono::high_resolution_clock::now();
-        vector<Point> nearest_neighbors = c2_k_ANN_Query(
-            queries[i], K, L, n, c, r_min, epsilon, beta, k, DETs
+        vector<pair<int, double>> nearest_neighbors = c2_k_ANN_Query(
+            queries.row(i), dataset, K, L, c, r_min, epsilon, beta, k, flat, lsh
         );
         auto end = chrono::high_resolution_clock::now();
 
@@ -239,21 +1361,30 @@ void test_indexing_with_queries(string dataset_path, string name) {
 
         cout << "Top-" << k << " nearest neighbors found:" << endl;
         for (const auto& neighbor : nearest_neighbors) {
-            cout << neighbor << endl;
+            cout << "Position: " << neighbor.first << ", Distance: " << neighbor.second << endl;
         }
 
         cout << "------------------------------------" << endl;
     }
 
-    // Liberar memoria de los DE-Trees
-    for (auto tree : DETs) {
-        delete tree;
-    }
+    // Los DE-Trees se liberan con sus arenas al salir de la función
 }
 
 
 int main() {
     test_create_index_with_split();
+    test_bulk_load_index();
+    test_region_bounds();
+    test_lsh_state();
+    test_encode_kernel();
+    test_packed_codes();
+    test_mapped_vecs();
+    test_quantile_sketch();
+    test_streaming_build();
+    test_build_determinism();
+    test_candidate_set();
+    test_rerank();
+    test_queries();
 
     // test_indexing_with_queries("./datasets/movielens/movielens_base.fvecs", "movielens");
     // test_indexing_with_queries("./datasets/audio/audio_base.fvecs", "audio");
@@ -0,0 +1,141 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+// Cola preferida del hilo actual; los hilos externos usan la última
+thread_local size_t current_queue = static_cast<size_t>(-1);
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = max<size_t>(1, thread::hardware_concurrency());
+    }
+    for (size_t t = 0; t < threads; ++t) {
+        queues.push_back(make_unique<WorkQueue>());
+    }
+    for (size_t t = 0; t + 1 < threads; ++t) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, t);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleep_mtx);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::submit(function<void()> task) {
+    size_t q = next_queue.fetch_add(1, memory_order_relaxed) % queues.size();
+    {
+        lock_guard<mutex> lock(queues[q]->mtx);
+        queues[q]->tasks.push_back(std::move(task));
+    }
+    queued.fetch_add(1);
+    // Tomar el mutex evita perder el aviso si un hilo está por dormirse
+    { lock_guard<mutex> lock(sleep_mtx); }
+    sleep_cv.notify_one();
+}
+
+bool ThreadPool::try_run_one(size_t preferred) {
+    function<void()> task;
+    const size_t count = queues.size();
+
+    // Primero la cola propia (LIFO), después robar de las demás (FIFO)
+    {
+        WorkQueue& own = *queues[preferred % count];
+        lock_guard<mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    for (size_t k = 1; !task && k < count; ++k) {
+        WorkQueue& victim = *queues[(preferred + k) % count];
+        lock_guard<mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task) return false;
+    queued.fetch_sub(1);
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(size_t id) {
+    current_queue = id;
+    while (true) {
+        if (try_run_one(id)) continue;
+
+        unique_lock<mutex> lock(sleep_mtx);
+        sleep_cv.wait(lock, [&] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) return;
+    }
+}
+
+ParallelStats ThreadPool::parallel_for(size_t n, size_t grain, const function<void(size_t, size_t)>& fn) {
+    ParallelStats stats;
+    stats.threads = size();
+    if (n == 0) return stats;
+    grain = max<size_t>(grain, 1);
+
+    auto start = steady_clock::now();
+    const size_t blocks = (n + grain - 1) / grain;
+
+    atomic<size_t> remaining(blocks);
+    atomic<long long> busy_ns(0);
+    exception_ptr error;
+    mutex error_mtx;
+
+    auto run_block = [&](size_t block) {
+        size_t begin = block * grain;
+        size_t end = min(n, begin + grain);
+        auto t0 = steady_clock::now();
+        try {
+            fn(begin, end);
+        } catch (...) {
+            lock_guard<mutex> lock(error_mtx);
+            if (!error) error = current_exception();
+        }
+        busy_ns.fetch_add(duration_cast<nanoseconds>(steady_clock::now() - t0).count());
+        remaining.fetch_sub(1);
+    };
+
+    if (workers.empty() || blocks == 1) {
+        for (size_t block = 0; block < blocks; ++block) run_block(block);
+    } else {
+        for (size_t block = 0; block < blocks; ++block) {
+            submit([&run_block, block] { run_block(block); });
+        }
+        // El hilo que llama ayuda hasta que se completen todos los bloques
+        size_t own = current_queue == static_cast<size_t>(-1) ? queues.size() - 1 : current_queue;
+        while (remaining.load() > 0) {
+            if (!try_run_one(own)) {
+                this_thread::yield();
+            }
+        }
+    }
+
+    stats.wall_us = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0;
+    stats.busy_us = busy_ns.load() / 1000.0;
+
+    if (error) rethrow_exception(error);
+    return stats;
+}
@@ -0,0 +1,69 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Resultado de un parallel_for: tiempo de pared y tiempo total de trabajo
+// sumado sobre todos los hilos. busy / wall es la utilización: cuántos
+// hilos trabajaron en promedio. No es la aceleración contra la versión
+// secuencial, que además paga el reparto y la espera de los hilos.
+struct ParallelStats {
+    double wall_us = 0.0;
+    double busy_us = 0.0;
+    size_t threads = 1;
+
+    double utilization() const { return wall_us > 0.0 ? busy_us / wall_us : 1.0; }
+};
+
+// Pool de hilos con robo de trabajo: cada hilo tiene su propia cola,
+// saca tareas del final de la suya y roba del frente de las demás.
+// El hilo que llama a parallel_for también ejecuta tareas mientras espera,
+// así que las llamadas anidadas no se bloquean.
+class ThreadPool {
+public:
+    // threads = paralelismo total (incluido el hilo que llama); 0 usa todos los núcleos
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    void submit(std::function<void()> task);
+
+    // Ejecuta fn(begin, end) sobre [0, n) en bloques de `grain` elementos y
+    // espera a que terminen todos. Cada bloque escribe en su propia salida,
+    // así que el resultado no depende del número de hilos.
+    ParallelStats parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+    // Pool compartido por todas las fases de construcción y consulta
+    static ThreadPool& shared();
+
+private:
+    struct WorkQueue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;  // Una por hilo, más la del que llama
+    std::vector<std::thread> workers;
+    std::mutex sleep_mtx;
+    std::condition_variable sleep_cv;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> next_queue{0};
+    bool stopping = false;
+
+    bool try_run_one(size_t preferred);
+    void worker_loop(size_t id);
+};
+
+#endif // THREAD_POOL_H
@@ -1,25 +1,122 @@
 #ifndef TREE_NODE_H
 #define TREE_NODE_H
 
-#include <vector>
-#include <utility> 
-#include "point.h" 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "arena.h"
 
-struct Point;
+// Nodo de un DE-Tree. El nodo y el arreglo de su hoja viven en el arena
+// del árbol (DETree), así que no tiene destructor: el árbol completo se
+// libera de una vez junto con su arena. Las hojas guardan sólo posiciones;
+// los códigos se leen de PackedCodes o del CodeBuffer (CodeView).
 struct TreeNode {
-    std::vector<std::pair<Point, int>> entries; 
-    TreeNode* left;   
-    TreeNode* right;  
-    std::vector<TreeNode*> children;
+    TreeNode* left = nullptr;
+    TreeNode* right = nullptr;
+    TreeNode** children = nullptr;  // Sólo la raíz: 2^K hijos
+    uint32_t child_count = 0;
+    int32_t split_dimension = -1;   // Dimensión cuyo bit separa left (0) de right (1)
+    int32_t split_bit = -1;         // Bit del código usado en la división
+
+    // Caja de regiones de los puntos del subárbol: lo en [0, K) y hi en
+    // [K, 2K). Vacía (lo > hi) mientras el subárbol no tenga puntos
+    uint8_t* box = nullptr;
+
+    // Hoja: `count` posiciones de puntos
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    uint32_t* ids = nullptr;
 
-    TreeNode() : left(nullptr), right(nullptr) {}
-    void add_entry(const Point& point, int value) {
-        entries.push_back(std::make_pair(point, value));
-    }
     bool is_leaf() const {
-    return left == nullptr && right == nullptr;}
-    void add_child(TreeNode* child) {
-        children.push_back(child);
+    return left == nullptr && right == nullptr && child_count == 0;}
+};
+
+// Un DE-Tree con el arena que guarda sus nodos y hojas
+struct DETree {
+    Arena arena;
+    TreeNode* root = nullptr;
+    int K = 0;
+    int Nr = 0;
+    uint32_t leaf_capacity = 0;  // Capacidad de las hojas nuevas: max_size + 1
+
+    DETree() = default;
+    DETree(int K, int Nr, int max_size)
+        : K(K), Nr(Nr), leaf_capacity(static_cast<uint32_t>(max_size) + 1) {
+        // Raíz con 2^K hijos vacíos
+        root = new_node();
+        root->child_count = uint32_t(1) << K;
+        root->children = arena.allocate_array<TreeNode*>(root->child_count);
+        for (uint32_t c = 0; c < root->child_count; ++c) {
+            root->children[c] = new_node();
+        }
+    }
+
+    DETree(DETree&& other) noexcept
+        : arena(std::move(other.arena)), root(other.root), K(other.K), Nr(other.Nr),
+          leaf_capacity(other.leaf_capacity) {
+        other.root = nullptr;
+    }
+    DETree& operator=(DETree&& other) noexcept {
+        arena = std::move(other.arena);
+        root = other.root;
+        K = other.K;
+        Nr = other.Nr;
+        leaf_capacity = other.leaf_capacity;
+        other.root = nullptr;
+        return *this;
+    }
+
+    TreeNode* new_node() {
+        TreeNode* node = arena.create<TreeNode>();
+        node->box = arena.allocate_array<uint8_t>(2 * size_t(K));
+        std::memset(node->box, 0xFF, K);
+        std::memset(node->box + K, 0, K);
+        return node;
+    }
+
+    // Agranda la caja del nodo para cubrir el código epi
+    void expand_box(TreeNode* node, const uint8_t* epi) const {
+        for (int j = 0; j < K; ++j) {
+            node->box[j] = std::min(node->box[j], epi[j]);
+            node->box[K + j] = std::max(node->box[K + j], epi[j]);
+        }
+    }
+
+    // Agranda la caja del nodo para cubrir la de otro
+    void merge_box(TreeNode* node, const TreeNode* other) const {
+        for (int j = 0; j < K; ++j) {
+            node->box[j] = std::min(node->box[j], other->box[j]);
+            node->box[K + j] = std::max(node->box[K + j], other->box[K + j]);
+        }
+    }
+
+    // Lleva la hoja a al menos `capacity` entradas; el arreglo viejo
+    // queda en el arena hasta que se libera el árbol
+    void reserve_leaf(TreeNode* leaf, uint32_t capacity) {
+        if (capacity <= leaf->capacity) return;
+        uint32_t* ids = arena.allocate_array<uint32_t>(capacity);
+        if (leaf->count > 0) {
+            std::memcpy(ids, leaf->ids, leaf->count * sizeof(uint32_t));
+        }
+        leaf->ids = ids;
+        leaf->capacity = capacity;
+    }
+
+    void add_entry(TreeNode* leaf, uint32_t id) {
+        if (leaf->count == leaf->capacity) {
+            reserve_leaf(leaf, std::max(leaf_capacity, 2 * leaf->capacity));
+        }
+        leaf->ids[leaf->count++] = id;
+    }
+
+    // Memoria exacta del árbol: todos los bloques de su arena
+    size_t bytes() const { return arena.bytes_reserved(); }
+
+    // Devuelve toda la memoria del árbol
+    void release() {
+        arena.release();
+        root = nullptr;
     }
 };
 
@@ -0,0 +1,228 @@
+#include "vecs_mmap.h"
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+VecsFormat vecs_format_from_path(const string& filename) {
+    auto ends_with = [&](const string& suffix) {
+        return filename.size() >= suffix.size() &&
+               filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".fvecs")) return VecsFormat::FVECS;
+    if (ends_with(".ivecs")) return VecsFormat::IVECS;
+    if (ends_with(".bvecs")) return VecsFormat::BVECS;
+    throw invalid_argument("Unknown vecs extension: " + filename);
+}
+
+MappedFile::MappedFile(const string& filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    length = static_cast<size_t>(file_size.QuadPart);
+    file_handle = file;
+    if (length > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            throw runtime_error("Error mapping file: " + filename);
+        }
+        mapping_handle = mapping;
+        base = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Error opening file: " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw runtime_error("Error reading size of file: " + filename);
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        void* ptr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        base = ptr == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(ptr);
+    }
+    // El mapeo sigue vivo después de cerrar el descriptor
+    ::close(fd);
+#endif
+    if (length > 0 && base == nullptr) {
+        close();
+        throw runtime_error("Error mapping file: " + filename);
+    }
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        base = other.base;
+        length = other.length;
+#ifdef _WIN32
+        file_handle = other.file_handle;
+        mapping_handle = other.mapping_handle;
+        other.file_handle = nullptr;
+        other.mapping_handle = nullptr;
+#endif
+        other.base = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (base != nullptr) UnmapViewOfFile(base);
+    if (mapping_handle != nullptr) CloseHandle(static_cast<HANDLE>(mapping_handle));
+    if (file_handle != nullptr) CloseHandle(static_cast<HANDLE>(file_handle));
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (base != nullptr) munmap(const_cast<unsigned char*>(base), length);
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+void MappedFile::advise_sequential() const {
+#ifndef _WIN32
+    if (base != nullptr) madvise(const_cast<unsigned char*>(base), length, MADV_SEQUENTIAL);
+#endif
+}
+
+void MappedFile::advise_willneed() const {
+#ifndef _WIN32
+    if (base != nullptr) madvise(const_cast<unsigned char*>(base), length, MADV_WILLNEED);
+#endif
+}
+
+MappedVecs::MappedVecs(const string& filename, bool verify_headers)
+    : MappedVecs(filename, vecs_format_from_path(filename), verify_headers) {}
+
+MappedVecs::MappedVecs(const string& filename, VecsFormat format, bool verify_headers)
+    : fmt(format) {
+    open(filename, verify_headers);
+}
+
+MappedVecs::~MappedVecs() {
+    close();
+}
+
+MappedVecs::MappedVecs(MappedVecs&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedVecs& MappedVecs::operator=(MappedVecs&& other) noexcept {
+    if (this != &other) {
+        file = std::move(other.file);
+        n = other.n;
+        d = other.d;
+        fmt = other.fmt;
+        other.n = other.d = 0;
+    }
+    return *this;
+}
+
+size_t MappedVecs::element_size() const {
+    return fmt == VecsFormat::BVECS ? sizeof(uint8_t) : sizeof(float);
+}
+
+// Tamaño de una fila en elementos, incluyendo la cabecera int32
+size_t MappedVecs::row_elements() const {
+    return d + sizeof(int32_t) / element_size();
+}
+
+void MappedVecs::open(const string& filename, bool verify_headers) {
+    file = MappedFile(filename);
+    const unsigned char* base = file.data();
+    const size_t length = file.size();
+    if (length == 0) {
+        return;
+    }
+
+    int32_t dim = 0;
+    memcpy(&dim, base, sizeof(int32_t));
+    if (dim <= 0) {
+        close();
+        throw runtime_error("Invalid vecs header in " + filename);
+    }
+    d = static_cast<size_t>(dim);
+
+    const size_t row_bytes = row_elements() * element_size();
+    if (length % row_bytes != 0) {
+        close();
+        throw runtime_error("Truncated vecs file: " + filename);
+    }
+    n = length / row_bytes;
+
+    // Las cabeceras se validan una sola vez al abrir; después las vistas
+    // asumen filas de tamaño fijo. Sin verify_headers basta con la última
+    // (una página más): recorrerlas todas tocaría cada página del archivo
+    auto check_row = [&](size_t i) {
+        int32_t header = 0;
+        memcpy(&header, base + i * row_bytes, sizeof(int32_t));
+        if (header != dim) {
+            close();
+            throw runtime_error("Inconsistent dimension in " + filename);
+        }
+    };
+    if (verify_headers) {
+        for (size_t i = 1; i < n; ++i) {
+            check_row(i);
+        }
+    } else {
+        check_row(n - 1);
+    }
+}
+
+void MappedVecs::close() {
+    file.close();
+    n = d = 0;
+}
+
+DatasetView MappedVecs::fvecs() const {
+    if (fmt != VecsFormat::FVECS) {
+        throw logic_error("Mapped file is not .fvecs");
+    }
+    const float* rows = reinterpret_cast<const float*>(file.data() + sizeof(int32_t));
+    return DatasetView(n == 0 ? nullptr : rows, n, d, row_elements());
+}
+
+IvecsView MappedVecs::ivecs() const {
+    if (fmt != VecsFormat::IVECS) {
+        throw logic_error("Mapped file is not .ivecs");
+    }
+    const int32_t* rows = reinterpret_cast<const int32_t*>(file.data() + sizeof(int32_t));
+    return IvecsView(n == 0 ? nullptr : rows, n, d, row_elements());
+}
+
+BvecsView MappedVecs::bvecs() const {
+    if (fmt != VecsFormat::BVECS) {
+        throw logic_error("Mapped file is not .bvecs");
+    }
+    const uint8_t* rows = file.data() + sizeof(int32_t);
+    return BvecsView(n == 0 ? nullptr : rows, n, d, row_elements());
+}
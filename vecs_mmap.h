@@ -0,0 +1,95 @@
+#ifndef VECS_MMAP_H
+#define VECS_MMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "dataset.h"
+
+// Formatos de los benchmarks de ANN: cada fila es [int32 d][d elementos]
+enum class VecsFormat {
+    FVECS,  // float32
+    IVECS,  // int32 (ground truth)
+    BVECS   // uint8 (SIFT1B)
+};
+
+// Deduce el formato a partir de la extensión (.fvecs, .ivecs, .bvecs)
+VecsFormat vecs_format_from_path(const std::string& filename);
+
+// Archivo completo mapeado en memoria de solo lectura. El mapeo vive
+// mientras viva el objeto (se puede mover, no copiar).
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+
+    // Sugerencias al kernel para lecturas secuenciales o para precargar el archivo
+    void advise_sequential() const;
+    void advise_willneed() const;
+
+    void close();
+
+private:
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+// Archivo .fvecs/.ivecs/.bvecs mapeado en memoria de solo lectura.
+// Las filas se exponen en su lugar como una vista con stride, saltando la
+// cabecera de cada fila, así que abrir el archivo no copia ni convierte nada:
+// el costo de un reinicio son los page faults de las filas que se tocan.
+// Al abrir se revisan la cabecera de la primera y de la última fila y que el
+// tamaño sea un múltiplo exacto de la fila; con verify_headers se revisan
+// además todas las cabeceras, lo que lee (y trae a memoria) todo el archivo.
+class MappedVecs {
+public:
+    MappedVecs() = default;
+    explicit MappedVecs(const std::string& filename, bool verify_headers = false);
+    MappedVecs(const std::string& filename, VecsFormat format, bool verify_headers = false);
+    ~MappedVecs();
+
+    MappedVecs(const MappedVecs&) = delete;
+    MappedVecs& operator=(const MappedVecs&) = delete;
+    MappedVecs(MappedVecs&& other) noexcept;
+    MappedVecs& operator=(MappedVecs&& other) noexcept;
+
+    size_t size() const { return n; }
+    size_t dim() const { return d; }
+    VecsFormat format() const { return fmt; }
+    size_t bytes() const { return file.size(); }
+
+    // Vistas tipadas; lanzan si el formato del archivo no coincide
+    DatasetView fvecs() const;
+    IvecsView ivecs() const;
+    BvecsView bvecs() const;
+
+    // Sugerencias al kernel para lecturas secuenciales o para precargar el archivo
+    void advise_sequential() const { file.advise_sequential(); }
+    void advise_willneed() const { file.advise_willneed(); }
+
+private:
+    MappedFile file;
+    size_t n = 0;
+    size_t d = 0;
+    VecsFormat fmt = VecsFormat::FVECS;
+
+    void open(const std::string& filename, bool verify_headers);
+    void close();
+    size_t element_size() const;
+    size_t row_elements() const;
+};
+
+#endif // VECS_MMAP_H